@@ -39,5 +39,10 @@ if defined DEV (
 )
 
 @echo on
-gcc %CFLAGS% -o bin/VectorFields src/main.c src/helpers.c src/ir.c %DEPS%
+if "%~1"=="bench" (
+	gcc %CFLAGS% -O2 -o bin/Bench.exe src/bench.c src/helpers.c src/ir.c src/jobs.c src/field.c src/palette.c src/particles.c src/softrast.c src/density.c %DEPS%
+	@echo off
+	exit /b
+)
+gcc %CFLAGS% -o bin/VectorFields src/main.c src/helpers.c src/ir.c src/jobs.c src/field.c src/palette.c src/particles.c src/softrast.c src/density.c src/capture.c %DEPS%
 @echo off
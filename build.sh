@@ -4,7 +4,7 @@ CFLAGS="-Wall -Wextra -Wimplicit -Wpedantic -Wno-unused-function -Wno-unused-var
 
 LIB_PATHS="-L./bin"
 INCLUDES="-I./deps/raylib/src -I./deps/ail"
-RAYLIB_DEP="-lraylib -lm"
+RAYLIB_DEP="-lraylib -lm -lpthread"
 DEPS="$INCLUDES $LIB_PATHS $RAYLIB_DEP"
 
 if [[ $1 == "a" ]] || [ ! -d "./bin" ]; then
@@ -28,4 +28,8 @@ else
 fi
 
 set -xe
-gcc $CFLAGS -o bin/VectorFields src/helpers.c src/ir.c src/main.c $DEPS
+if [[ $1 == "bench" ]]; then
+	gcc $CFLAGS -O2 -o bin/Bench src/helpers.c src/ir.c src/jobs.c src/field.c src/palette.c src/particles.c src/softrast.c src/density.c src/bench.c $DEPS
+	exit
+fi
+gcc $CFLAGS -o bin/VectorFields src/helpers.c src/ir.c src/jobs.c src/field.c src/palette.c src/particles.c src/softrast.c src/density.c src/capture.c src/main.c $DEPS
@@ -0,0 +1,201 @@
+#include "raylib.h"
+#include "rlgl.h"
+#define AIL_ALL_IMPL
+#include "ail.h"
+#include <stdio.h>
+#include <string.h>
+#include "helpers.h"
+#include "ir.h"
+#include "jobs.h"
+#include "field.h"
+#include "particles.h"
+#include "softrast.h"
+#include "density.h"
+
+// Benchmarks of the hot paths of simulating and drawing, which run without showing a window
+// Usage: Bench [sort|lines|softrast|density]
+
+#define BENCH_WIDTH     3840 // Large enough for the field grid to be several megabytes
+#define BENCH_HEIGHT    2160
+#define BENCH_ZOOM      10.0f
+#define BENCH_PARTICLES 1000000
+#define BENCH_RUNS      20
+#define BENCH_MAX_THREADS 64
+#define BENCH_LINE_FRAMES 20
+
+static Field_Grid grid;
+static Particles  ps;
+static float      sinks[BENCH_MAX_THREADS*16]; // Per-thread results, padded to separate cache lines, so lookups can't be optimized away
+
+static void lookupBlock(void *arg, u32 from, u32 to, u32 thread)
+{
+    (void)arg;
+    float sum = 0;
+    for (u32 i = from; i < to; i++) {
+        Vector2 v;
+        if (fieldGridSample(&grid, ps.xs[i], ps.ys[i], &v)) sum += v.x + v.y;
+    }
+    sinks[(thread % BENCH_MAX_THREADS)*16] += sum;
+}
+
+// Returns the lookup throughput in millions of lookups per second
+static double benchLookups(void)
+{
+    double start = getTimeSecs();
+    for (u32 r = 0; r < BENCH_RUNS; r++) jobsParallelFor(lookupBlock, NULL, BENCH_PARTICLES, PARTICLES_BLOCK);
+    return (double)BENCH_RUNS*BENCH_PARTICLES/(getTimeSecs() - start)/1e6;
+}
+
+static void benchSort(void)
+{
+    char func[] = "(vec2 (sin (+ x y)) (cos (* x y)))";
+    IR root = {0};
+    parseUserFunc(func, strlen(func), &root);
+    checkUserFunc(&root);
+    while (!fieldGridUpdate(&grid, root, 1, BENCH_ZOOM, BENCH_WIDTH, BENCH_HEIGHT, 1.0)) {}
+
+    particlesInit(&ps, BENCH_PARTICLES);
+    for (u32 i = 0; i < BENCH_PARTICLES; i++) {
+        ps.xs[i]        = xorshiftf(0, BENCH_WIDTH);
+        ps.ys[i]        = xorshiftf(0, BENCH_HEIGHT);
+        ps.lifetimes[i] = 1;
+    }
+    printf("Grid: %dx%d samples (%.1f MB), %u particles, %u threads\n",
+           grid.cols, grid.rows, grid.cols*grid.rows*sizeof(Vector2)/1e6, BENCH_PARTICLES, jobsThreadCount());
+    printf("Unsorted: %8.2f M lookups/s\n", benchLookups());
+
+    Particle_Sort sort = {0};
+    particlesSort(&ps, BENCH_PARTICLES, BENCH_WIDTH, BENCH_HEIGHT, &sort); // First sort includes allocating the scratch space
+    double start = getTimeSecs();
+    particlesSort(&ps, BENCH_PARTICLES, BENCH_WIDTH, BENCH_HEIGHT, &sort);
+    double sortMs = 1000.0*(getTimeSecs() - start);
+    printf("Sorted:   %8.2f M lookups/s (sorting took %.2f ms)\n", benchLookups(), sortMs);
+
+    particleSortFree(&sort);
+    particlesFree(&ps);
+    fieldGridFree(&grid);
+}
+
+// Milliseconds per frame, that drawing lines took
+typedef struct {
+    double submitMs; // CPU time spent on building & submitting the draw calls
+    double swapMs;   // Time spent swapping buffers, which includes waiting for the GPU to finish drawing
+} Bench_Line_Times;
+
+// @Note: The window is created without vsync, so swapping buffers only waits for the GPU
+static Bench_Line_Times benchLineFrames(const Line_Batch *batch, Line_Renderer *renderer)
+{
+    double submit = 0;
+    double swap   = 0;
+    for (u32 f = 0; f < BENCH_LINE_FRAMES; f++) {
+        BeginDrawing();
+        ClearBackground(BLACK);
+        double t = getTimeSecs();
+        if (renderer) lineRendererDraw(renderer, batch);
+        else          lineBatchDraw(batch);
+        rlDrawRenderBatchActive();
+        submit += getTimeSecs() - t;
+        t = getTimeSecs();
+        EndDrawing();
+        swap += getTimeSecs() - t;
+    }
+    return (Bench_Line_Times){ 1000.0*submit/BENCH_LINE_FRAMES, 1000.0*swap/BENCH_LINE_FRAMES };
+}
+
+static void benchLines(void)
+{
+    SetConfigFlags(FLAG_WINDOW_HIDDEN);
+    InitWindow(1280, 720, "Bench");
+    Line_Renderer renderer;
+    lineRendererInit(&renderer, 1000000);
+    if (!renderer.shader) printf("Vertex buffers can't be mapped, so both rows measure immediate mode\n");
+    u32 counts[] = { 10000, 100000, 1000000 };
+    Line_Batch batch = {0};
+    for (u32 i = 0; i < AIL_ARRLEN(counts); i++) {
+        // Short lines spread over the screen, like the particles draw them
+        lineBatchReserve(&batch, counts[i]);
+        batch.len = counts[i];
+        for (u32 j = 0; j < batch.len; j++) {
+            Vector2 p = { xorshiftf(0, 1280), xorshiftf(0, 720) };
+            batch.points[2*j]     = p;
+            batch.points[2*j + 1] = (Vector2){ p.x + xorshiftf(-2, 2), p.y + xorshiftf(-2, 2) };
+            batch.colors[j]       = ColorFromHSV(xorshiftf(0, 360), 1.0f, 1.0f);
+        }
+        Bench_Line_Times immediate = benchLineFrames(&batch, NULL);
+        Bench_Line_Times buffered  = benchLineFrames(&batch, &renderer);
+        printf("%7u lines: immediate %8.2f ms submitting + %8.2f ms swapping, vertex buffer %8.2f ms submitting + %8.2f ms swapping\n",
+               counts[i], immediate.submitMs, immediate.swapMs, buffered.submitMs, buffered.swapMs);
+    }
+    lineBatchFree(&batch);
+    lineRendererFree(&renderer);
+    CloseWindow();
+}
+
+// Same lines as benchLines, but rasterized on the CPU without opening a window
+static void benchSoftrast(void)
+{
+    Soft_Raster raster;
+    softrastInit(&raster, 1280, 720);
+    u32 counts[] = { 10000, 100000, 1000000 };
+    Line_Batch batch = {0};
+    for (u32 i = 0; i < AIL_ARRLEN(counts); i++) {
+        lineBatchReserve(&batch, counts[i]);
+        batch.len = counts[i];
+        for (u32 j = 0; j < batch.len; j++) {
+            Vector2 p = { xorshiftf(0, 1280), xorshiftf(0, 720) };
+            batch.points[2*j]     = p;
+            batch.points[2*j + 1] = (Vector2){ p.x + xorshiftf(-2, 2), p.y + xorshiftf(-2, 2) };
+            batch.colors[j]       = ColorFromHSV(xorshiftf(0, 360), 1.0f, 1.0f);
+        }
+        double start = getTimeSecs();
+        for (u32 f = 0; f < BENCH_LINE_FRAMES; f++) {
+            softrastDecay(&raster, 0.96f);
+            softrastDrawLines(&raster, &batch);
+        }
+        printf("%7u lines: %8.2f ms/frame on %u threads\n", counts[i], 1000.0*(getTimeSecs() - start)/BENCH_LINE_FRAMES, jobsThreadCount());
+    }
+    lineBatchFree(&batch);
+    softrastFree(&raster);
+}
+
+// Same lines as benchSoftrast, but splatted into the density histograms and tone mapped
+static void benchDensity(void)
+{
+    Density_Map map;
+    densityInit(&map, 1280, 720);
+    Color *pixels = malloc(1280*720*sizeof(Color));
+    u32 counts[] = { 10000, 100000, 1000000 };
+    Line_Batch batch = {0};
+    for (u32 i = 0; i < AIL_ARRLEN(counts); i++) {
+        lineBatchReserve(&batch, counts[i]);
+        batch.len = counts[i];
+        for (u32 j = 0; j < batch.len; j++) {
+            Vector2 p = { xorshiftf(0, 1280), xorshiftf(0, 720) };
+            batch.points[2*j]     = p;
+            batch.points[2*j + 1] = (Vector2){ p.x + xorshiftf(-2, 2), p.y + xorshiftf(-2, 2) };
+            batch.colors[j]       = ColorFromHSV(xorshiftf(0, 360), 1.0f, 1.0f);
+        }
+        double start = getTimeSecs();
+        for (u32 f = 0; f < BENCH_LINE_FRAMES; f++) {
+            densitySplat(&map, &batch);
+            densityResolve(&map, 0.96f, pixels);
+        }
+        printf("%7u lines: %8.2f ms/frame on %u threads\n", counts[i], 1000.0*(getTimeSecs() - start)/BENCH_LINE_FRAMES, jobsThreadCount());
+    }
+    lineBatchFree(&batch);
+    free(pixels);
+    densityFree(&map);
+}
+
+int main(int argc, char **argv)
+{
+    jobsInit(0);
+    const char *bench = argc > 1 ? argv[1] : "sort";
+    if      (!strcmp(bench, "sort"))     benchSort();
+    else if (!strcmp(bench, "lines"))    benchLines();
+    else if (!strcmp(bench, "softrast")) benchSoftrast();
+    else if (!strcmp(bench, "density"))  benchDensity();
+    else printf("Unknown benchmark '%s'\nAvailable benchmarks: sort, lines, softrast, density\n", bench);
+    jobsDeinit();
+    return 0;
+}
@@ -0,0 +1,452 @@
+#include "capture.h"
+#include <stdio.h>
+#include <math.h>
+#include <signal.h>
+#ifdef _WIN32
+#   include <io.h>
+#   include <fcntl.h>
+#endif
+#include "raylib.h"
+#include "external/msf_gif.h" // @Note: Implemented by raylib, which uses it for its own recordings
+#include "external/glad.h"    // @Note: Loaded by raylib, whose OpenGL 3.3 backend has no asynchronous reads
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#   include <emmintrin.h>
+#   define YUV_SSE2
+#endif
+
+// Queues a copy of the framebuffer's width*height RGBA pixels into the next free PBO
+// @Note: Leaves the default framebuffer bound for reading, so this shouldn't be called while drawing into a render texture
+bool readbackStart(Gpu_Readback *rb, u32 framebuffer, i32 width, i32 height)
+{
+    if (rb->pending == READBACK_BUFFERS) return false;
+    Readback_Buffer *buf = &rb->buffers[(rb->first + rb->pending) % READBACK_BUFFERS];
+    u32 size = 4*width*height;
+    if (!buf->pbo) glGenBuffers(1, &buf->pbo);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, buf->pbo);
+    if (buf->size != size) {
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+        buf->size = size;
+    }
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    buf->fence  = glFenceSync ? glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0) : NULL;
+    buf->width  = width;
+    buf->height = height;
+    rb->pending++;
+    return true;
+}
+
+bool readbackPoll(Gpu_Readback *rb, bool wait, i32 *width, i32 *height)
+{
+    if (!rb->pending) return false;
+    Readback_Buffer *buf = &rb->buffers[rb->first];
+    if (!wait && buf->fence) {
+        GLenum status = glClientWaitSync(buf->fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) return false;
+    }
+    *width  = buf->width;
+    *height = buf->height;
+    return true;
+}
+
+// Copies the oldest read into pixels, which need to hold its width*height RGBA pixels
+// Rows are stored bottom to top as in OpenGL, or top to bottom if flip is set
+void readbackFinish(Gpu_Readback *rb, u8 *pixels, bool flip)
+{
+    if (!rb->pending) return;
+    Readback_Buffer *buf = &rb->buffers[rb->first];
+    if (pixels) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, buf->pbo);
+        const u8 *mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, buf->size, GL_MAP_READ_BIT);
+        if (mapped) {
+            u32 pitch = 4*buf->width;
+            if (flip) {
+                for (i32 y = 0; y < buf->height; y++) memcpy(pixels + y*pitch, mapped + (buf->height - 1 - y)*pitch, pitch);
+            } else {
+                memcpy(pixels, mapped, buf->size);
+            }
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+    if (buf->fence) glDeleteSync(buf->fence);
+    buf->fence = NULL;
+    rb->first  = (rb->first + 1) % READBACK_BUFFERS;
+    rb->pending--;
+}
+
+// Needs to be called before the window is closed
+void readbackFree(Gpu_Readback *rb)
+{
+    while (rb->pending) readbackFinish(rb, NULL, false);
+    for (u32 i = 0; i < READBACK_BUFFERS; i++) {
+        if (rb->buffers[i].pbo) glDeleteBuffers(1, &rb->buffers[i].pbo);
+    }
+    *rb = (Gpu_Readback){0};
+}
+
+static void gifEncodeLoop(void *arg)
+{
+    Gif_Recorder *rec = arg;
+    MsfGifState gif = {0};
+    msf_gif_begin(&gif, rec->width, rec->height);
+    u32 frames = 0;
+    for (;;) {
+        // @Note: stop is read before the ring, so frames published before stopping are always encoded
+        bool stop   = atomic_load(&rec->stop);
+        u8  *pixels = ringPeek(&rec->ring);
+        if (!pixels) {
+            if (stop) break;
+            sleepSecs(GIF_IDLE_SLEEP_MS/1000.0f);
+            continue;
+        }
+        // Frames are stored bottom row first, which the negative pitch flips
+        msf_gif_frame(&gif, pixels, 100/GIF_FPS, GIF_BIT_DEPTH, -4*rec->width);
+        ringRelease(&rec->ring);
+        frames++;
+    }
+    MsfGifResult res = msf_gif_end(&gif);
+    if (res.data && SaveFileData(rec->path, res.data, res.dataSize)) printf("Saved %s (%u frames, %u dropped)\n", rec->path, frames, rec->dropped);
+    else printf("Failed to save %s\n", rec->path);
+    msf_gif_free(res);
+    atomic_store(&rec->finished, true);
+}
+
+bool gifRecorderStart(Gif_Recorder *rec, const char *path, i32 width, i32 height)
+{
+    if (rec->thread) return false;
+    rec->width        = width;
+    rec->height       = height;
+    rec->sinceCapture = 1.0f/GIF_FPS; // The first frame is captured right away
+    rec->captured     = 0;
+    rec->dropped      = 0;
+    snprintf(rec->path, sizeof(rec->path), "%s", path);
+    for (u32 i = 0; i < GIF_BUFFERS; i++) {
+        rec->buffers[i]    = malloc(4*width*height);
+        rec->bufferPtrs[i] = rec->buffers[i];
+    }
+    ringInit(&rec->ring, rec->bufferPtrs, GIF_BUFFERS);
+    atomic_store(&rec->stop, false);
+    atomic_store(&rec->finished, false);
+    rec->thread = jobsStartThread(gifEncodeLoop, rec);
+    if (!rec->thread) {
+        for (u32 i = 0; i < GIF_BUFFERS; i++) free(rec->buffers[i]);
+        return false;
+    }
+    return true;
+}
+
+bool gifRecorderRecording(const Gif_Recorder *rec)
+{
+    return rec->thread && !atomic_load(&rec->stop);
+}
+
+// Returns whether a frame should be captured, dt seconds after the previous call
+bool gifRecorderDue(Gif_Recorder *rec, float dt)
+{
+    if (!gifRecorderRecording(rec)) return false;
+    rec->sinceCapture += dt;
+    if (rec->sinceCapture < 1.0f/GIF_FPS) return false;
+    // @Note: Keeping the remainder keeps the recording at GIF_FPS on average, even if the frame rate isn't a multiple of it
+    rec->sinceCapture = fmodf(rec->sinceCapture, 1.0f/GIF_FPS);
+    return true;
+}
+
+// Returns a free buffer to copy the frame into, or NULL if the frame has to be dropped
+// Frames are dropped while the encoder is busy with all buffers, or if they don't have the size the recording was started with
+u8 *gifRecorderAcquire(Gif_Recorder *rec, i32 width, i32 height)
+{
+    u8 *pixels = width == rec->width && height == rec->height ? ringAcquire(&rec->ring) : NULL;
+    if (!pixels) rec->dropped++;
+    return pixels;
+}
+
+void gifRecorderPublish(Gif_Recorder *rec)
+{
+    ringPublish(&rec->ring);
+    rec->captured++;
+}
+
+// The remaining frames are encoded and the file is written in the background
+void gifRecorderStop(Gif_Recorder *rec)
+{
+    if (rec->thread) atomic_store(&rec->stop, true);
+}
+
+// Cleans up once the encoder finished, which makes it possible to start the next recording
+void gifRecorderUpdate(Gif_Recorder *rec)
+{
+    if (!rec->thread || !atomic_load(&rec->finished)) return;
+    jobsJoinThread(rec->thread);
+    rec->thread = NULL;
+    for (u32 i = 0; i < GIF_BUFFERS; i++) free(rec->buffers[i]);
+}
+
+// Blocks until a running recording was written to disk
+void gifRecorderFree(Gif_Recorder *rec)
+{
+    gifRecorderStop(rec);
+    while (rec->thread) {
+        gifRecorderUpdate(rec);
+        if (rec->thread) sleepSecs(GIF_IDLE_SLEEP_MS/1000.0f);
+    }
+}
+
+#ifdef YUV_SSE2
+// Sums 2 blocks of 2x2 pixels, whose rows start at top and bottom, into the 16 bit r, g, b & a of both blocks
+static inline __m128i sumBlocks(const u8 *top, const u8 *bottom)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i t    = _mm_loadu_si128((const __m128i *)top);
+    __m128i b    = _mm_loadu_si128((const __m128i *)bottom);
+    __m128i lo   = _mm_add_epi16(_mm_unpacklo_epi8(t, zero), _mm_unpacklo_epi8(b, zero)); // Columns 0 & 1
+    __m128i hi   = _mm_add_epi16(_mm_unpackhi_epi8(t, zero), _mm_unpackhi_epi8(b, zero)); // Columns 2 & 3
+    lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+    hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+    return _mm_unpacklo_epi64(lo, hi);
+}
+
+// Weighs the sums of 4 blocks with the weights of r, g, b & a, which repeat every 4 lanes, and scales them to 4 chroma values
+static inline __m128i chromaOf4(__m128i blocks01, __m128i blocks23, __m128i weights)
+{
+    __m128  a    = _mm_castsi128_ps(_mm_madd_epi16(blocks01, weights));
+    __m128  b    = _mm_castsi128_ps(_mm_madd_epi16(blocks23, weights));
+    __m128i even = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0))); // r & g of every block
+    __m128i odd  = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))); // b & a of every block
+    return _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(even, odd), _mm_set1_epi32((128 << 10) + 512)), 10);
+}
+#endif
+
+// Converts to full-range BT.601, as expected by C420jpeg, with chroma averaged over blocks of 2x2 pixels
+// @Note: Uses SSE2 for 8 luma or chroma values at once where available. The scalar loops handle the remaining pixels with the same integer arithmetic, so both give identical results
+static void rgbaToYuv420(const u8 *rgba, i32 width, i32 height, u8 *yuv)
+{
+    i32 cw = (width  + 1)/2;
+    i32 ch = (height + 1)/2;
+    u8 *ys = yuv;
+    u8 *us = ys + width*height;
+    u8 *vs = us + cw*ch;
+    i32 i  = 0;
+#ifdef YUV_SSE2
+    // @Note: The weighted sums stay below 2^16, so they can wrap around as signed 16 bit values and be shifted as unsigned ones
+    __m128i mask = _mm_set1_epi32(0xFF);
+    for (; i + 8 <= width*height; i += 8) {
+        __m128i p0 = _mm_loadu_si128((const __m128i *)&rgba[4*i]);
+        __m128i p1 = _mm_loadu_si128((const __m128i *)&rgba[4*i + 16]);
+        __m128i r  = _mm_packs_epi32(_mm_and_si128(p0, mask), _mm_and_si128(p1, mask));
+        __m128i g  = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 8),  mask), _mm_and_si128(_mm_srli_epi32(p1, 8),  mask));
+        __m128i b  = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 16), mask), _mm_and_si128(_mm_srli_epi32(p1, 16), mask));
+        __m128i y  = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(77)), _mm_mullo_epi16(g, _mm_set1_epi16(150))),
+                                   _mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(29)), _mm_set1_epi16(128)));
+        y = _mm_srli_epi16(y, 8);
+        _mm_storel_epi64((__m128i *)&ys[i], _mm_packus_epi16(y, y));
+    }
+    __m128i uWeights = _mm_setr_epi16(-43, -85, 128, 0, -43, -85, 128, 0);
+    __m128i vWeights = _mm_setr_epi16(128, -107, -21, 0, 128, -107, -21, 0);
+#endif
+    for (; i < width*height; i++) {
+        const u8 *p = &rgba[4*i];
+        ys[i] = (77*p[0] + 150*p[1] + 29*p[2] + 128) >> 8;
+    }
+    for (i32 cy = 0; cy < ch; cy++) {
+        const u8 *top    = &rgba[4*width*(2*cy)];
+        const u8 *bottom = &rgba[4*width*AIL_MIN(2*cy + 1, height - 1)];
+        i32 cx = 0;
+#ifdef YUV_SSE2
+        // 8 blocks at once, as long as all of their 16 columns are inside the image
+        for (; 2*cx + 16 <= width; cx += 8) {
+            const u8 *t  = &top[4*2*cx];
+            const u8 *b  = &bottom[4*2*cx];
+            __m128i   b0 = sumBlocks(t,      b);
+            __m128i   b1 = sumBlocks(t + 16, b + 16);
+            __m128i   b2 = sumBlocks(t + 32, b + 32);
+            __m128i   b3 = sumBlocks(t + 48, b + 48);
+            // Packing saturates, which clamps the chroma to 255 like the scalar loop
+            __m128i   u  = _mm_packs_epi32(chromaOf4(b0, b1, uWeights), chromaOf4(b2, b3, uWeights));
+            __m128i   v  = _mm_packs_epi32(chromaOf4(b0, b1, vWeights), chromaOf4(b2, b3, vWeights));
+            _mm_storel_epi64((__m128i *)&us[cy*cw + cx], _mm_packus_epi16(u, u));
+            _mm_storel_epi64((__m128i *)&vs[cy*cw + cx], _mm_packus_epi16(v, v));
+        }
+#endif
+        for (; cx < cw; cx++) {
+            i32 x0 = 4*(2*cx);
+            i32 x1 = 4*AIL_MIN(2*cx + 1, width - 1);
+            i32 r  = top[x0 + 0] + top[x1 + 0] + bottom[x0 + 0] + bottom[x1 + 0];
+            i32 g  = top[x0 + 1] + top[x1 + 1] + bottom[x0 + 1] + bottom[x1 + 1];
+            i32 b  = top[x0 + 2] + top[x1 + 2] + bottom[x0 + 2] + bottom[x1 + 2];
+            // Sums of 4 pixels are scaled by 1/1024 instead of 1/256. The offset of 128 keeps the shifted values positive
+            i32 u  = (-43*r -  85*g + 128*b + (128 << 10) + 512) >> 10;
+            i32 v  = (128*r - 107*g -  21*b + (128 << 10) + 512) >> 10;
+            us[cy*cw + cx] = AIL_MIN(u, 255);
+            vs[cy*cw + cx] = AIL_MIN(v, 255);
+        }
+    }
+}
+
+static void streamWriteLoop(void *arg)
+{
+    Frame_Stream *stream = arg;
+    u32 size = 4*stream->width*stream->height;
+    for (;;) {
+        bool stop   = atomic_load(&stream->stop);
+        u8  *pixels = ringPeek(&stream->ring);
+        if (!pixels) {
+            if (stop) break;
+            sleepSecs(STREAM_WAIT_SLEEP_MS/1000.0f);
+            continue;
+        }
+        bool ok;
+        if (stream->format == STREAM_Y4M) {
+            rgbaToYuv420(pixels, stream->width, stream->height, stream->yuv);
+            // The next frame can be filled in while this one is written
+            ringRelease(&stream->ring);
+            ok = fwrite("FRAME\n", 1, 6, stream->file) == 6 && fwrite(stream->yuv, 1, stream->yuvSize, stream->file) == stream->yuvSize;
+        } else {
+            ok = fwrite(pixels, 1, size, stream->file) == size;
+            ringRelease(&stream->ring);
+        }
+        if (!ok) {
+            atomic_store(&stream->failed, true);
+            break;
+        }
+        stream->written++;
+    }
+    fflush(stream->file);
+}
+
+bool frameStreamOpen(Frame_Stream *stream, const char *path, Stream_Format format, i32 width, i32 height, i32 fps)
+{
+    *stream = (Frame_Stream){ .format = format, .width = width, .height = height, .fps = fps };
+    bool toStdout = !strcmp(path, "-");
+    if (toStdout) {
+#ifdef _WIN32
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        stream->file = stdout;
+    } else {
+        // @Note: Opening a named pipe blocks until a reader opened it as well
+        stream->file = fopen(path, "wb");
+        if (!stream->file) return false;
+    }
+#ifdef SIGPIPE
+    // A reader closing the pipe makes writing fail instead of killing the process
+    signal(SIGPIPE, SIG_IGN);
+#endif
+    if (format == STREAM_Y4M) {
+        stream->yuvSize = width*height + 2*((width + 1)/2)*((height + 1)/2);
+        stream->yuv     = malloc(stream->yuvSize);
+        fprintf(stream->file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height, fps);
+    }
+    for (u32 i = 0; i < STREAM_BUFFERS; i++) {
+        stream->buffers[i]    = malloc(4*width*height);
+        stream->bufferPtrs[i] = stream->buffers[i];
+    }
+    ringInit(&stream->ring, stream->bufferPtrs, STREAM_BUFFERS);
+    stream->thread = jobsStartThread(streamWriteLoop, stream);
+    if (!stream->thread) {
+        frameStreamClose(stream);
+        return false;
+    }
+    return true;
+}
+
+// Returns whether a frame should be captured, dt seconds after the previous call, to keep the stream at its frame rate
+bool frameStreamDue(Frame_Stream *stream, float dt)
+{
+    stream->sinceCapture += dt;
+    if (stream->sinceCapture < 1.0f/stream->fps) return false;
+    stream->sinceCapture = fmodf(stream->sinceCapture, 1.0f/stream->fps);
+    return true;
+}
+
+// Returns the buffer to render the next frame into, waiting while the writer still uses both buffers
+// Unless wait is set, the frame is dropped instead of waiting. Returns NULL once writing failed
+u8 *frameStreamAcquire(Frame_Stream *stream, bool wait)
+{
+    u8 *pixels = NULL;
+    for (bool waited = false; !pixels && !atomic_load(&stream->failed); waited = true) {
+        pixels = ringAcquire(&stream->ring);
+        if (pixels) stream->stalls += waited;
+        else if (!wait) break;
+        else sleepSecs(STREAM_WAIT_SLEEP_MS/1000.0f);
+    }
+    if (!pixels) stream->dropped++;
+    return pixels;
+}
+
+void frameStreamPublish(Frame_Stream *stream)
+{
+    ringPublish(&stream->ring);
+    stream->captured++;
+}
+
+// Writes the remaining frames and closes the file
+void frameStreamClose(Frame_Stream *stream)
+{
+    if (stream->thread) {
+        atomic_store(&stream->stop, true);
+        jobsJoinThread(stream->thread);
+        stream->thread = NULL;
+    }
+    if (stream->file && stream->file != stdout) fclose(stream->file);
+    stream->file = NULL;
+    for (u32 i = 0; i < STREAM_BUFFERS; i++) free(stream->buffers[i]);
+    free(stream->yuv);
+}
+
+// Returns a free job with a buffer for width*height pixels, or NULL if all pool->cap jobs are still being written
+Png_Job *pngPoolAcquire(Png_Pool *pool, i32 width, i32 height)
+{
+    Png_Job *job = NULL;
+    for (u32 i = 0; i < pool->len && !job; i++) {
+        if (!atomic_load(&pool->jobs[i]->busy)) job = pool->jobs[i];
+    }
+    if (!job) {
+        if (pool->len >= pool->cap) return NULL;
+        pool->jobs = realloc(pool->jobs, (pool->len + 1)*sizeof(Png_Job *));
+        job = calloc(1, sizeof(Png_Job));
+        pool->jobs[pool->len++] = job;
+    }
+    if (job->width != width || job->height != height) {
+        job->pixels = realloc(job->pixels, 4*width*height);
+        job->width  = width;
+        job->height = height;
+    }
+    return job;
+}
+
+static void pngWrite(void *arg)
+{
+    Png_Job *job = arg;
+    Image img = { job->pixels, job->width, job->height, 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8 };
+    if (!ExportImage(img, job->path)) fprintf(stderr, "Failed to write '%s'\n", job->path);
+    atomic_store(&job->busy, false);
+}
+
+// Writes the job's pixels to its path on a background thread
+void pngPoolSave(Png_Job *job)
+{
+    atomic_store(&job->busy, true);
+    if (!jobsBackground(pngWrite, job)) pngWrite(job);
+}
+
+// Blocks until all images were written
+void pngPoolWait(Png_Pool *pool)
+{
+    for (u32 i = 0; i < pool->len; i++) {
+        while (atomic_load(&pool->jobs[i]->busy)) sleepSecs(PNG_WAIT_SLEEP_MS/1000.0f);
+    }
+}
+
+void pngPoolFree(Png_Pool *pool)
+{
+    pngPoolWait(pool);
+    for (u32 i = 0; i < pool->len; i++) {
+        free(pool->jobs[i]->pixels);
+        free(pool->jobs[i]);
+    }
+    free(pool->jobs);
+    *pool = (Png_Pool){0};
+}
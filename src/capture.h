@@ -0,0 +1,121 @@
+#ifndef _CAPTURE_H_
+#define _CAPTURE_H_
+
+#define  AIL_ALL_IMPL
+#include "ail.h"
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include "jobs.h"
+
+#define GIF_BUFFERS          4     // Frames that may wait for the encoder at once. Frames captured while all of them are in use are dropped
+#define GIF_FPS              25    // Frames per second of recordings. GIFs store frame durations in centiseconds, so this should divide 100
+#define GIF_BIT_DEPTH        16    // Maximum bits per pixel the encoder may quantize colors to
+#define GIF_IDLE_SLEEP_MS    2.0f  // Time the encoder sleeps, while no frame is waiting
+#define STREAM_BUFFERS       2     // One frame is filled while the other one is converted & written
+#define STREAM_WAIT_SLEEP_MS 0.5f  // Time the writer and the producer sleep, while waiting for each other
+#define PNG_WAIT_SLEEP_MS    1.0f  // Time spent sleeping, while waiting for images to be written
+#define READBACK_BUFFERS     2     // Reads that may be in flight at once, so a frame's pixels are mapped while the next frame is read
+
+// Records frames into a GIF, which is encoded on its own thread and written to disk once the recording stops
+// @Note: The render thread only copies frames into free buffers, so recording never waits for the encoder
+typedef struct {
+    i32          width;
+    i32          height;
+    char         path[64];
+    u8          *buffers[GIF_BUFFERS]; // width*height RGBA pixels each, bottom row first
+    void        *bufferPtrs[GIF_BUFFERS];
+    Job_Ring     ring;                 // Hands captured frames from the render thread to the encoder
+    Job_Thread  *thread;               // NULL while neither recording nor encoding
+    atomic_bool  stop;                 // Set once no more frames will be captured
+    atomic_bool  finished;             // Set by the encoder once the file was written
+    float        sinceCapture;         // Seconds since the last captured frame
+    u32          captured;
+    u32          dropped;
+} Gif_Recorder;
+
+typedef enum {
+    STREAM_Y4M,  // YUV 4:2:0 in the YUV4MPEG2 container, which ffmpeg and most other encoders read directly
+    STREAM_RGBA, // Raw RGBA frames without any header
+} Stream_Format;
+
+// Writes uncompressed frames to a file, a named pipe or stdout on its own thread
+// @Note: Once both buffers are in use, acquiring the next one waits for the writer, so a slow reader throttles whoever produces the frames
+typedef struct {
+    FILE         *file;
+    Stream_Format format;
+    i32           width;
+    i32           height;
+    u8           *buffers[STREAM_BUFFERS]; // width*height RGBA pixels each, top row first
+    void         *bufferPtrs[STREAM_BUFFERS];
+    u8           *yuv;                     // Planes of the frame being written, only used by the writer
+    u32           yuvSize;
+    Job_Ring      ring;
+    Job_Thread   *thread;
+    atomic_bool   stop;
+    atomic_bool   failed;                  // Set once writing failed, e.g. because the reader closed the pipe
+    i32           fps;
+    float         sinceCapture;            // Seconds since the last captured frame, when streaming from the window
+    u32           captured;                // Frames handed to the writer
+    u32           written;                 // Only read by others once the stream was closed, since the writer counts it
+    u32           stalls;                  // Frames that had to wait for the writer
+    u32           dropped;                 // Frames skipped, because the writer still used both buffers
+} Frame_Stream;
+
+// Image that is written to a PNG file on a background thread
+typedef struct {
+    u8         *pixels; // width*height RGBA pixels, top row first
+    i32         width;
+    i32         height;
+    char        path[256];
+    atomic_bool busy;   // Set while the image is queued or being written
+} Png_Job;
+
+// Reusable buffers for images that are being written in the background
+// @Note: Jobs are allocated individually, so they don't move while being written, when the pool grows
+typedef struct {
+    Png_Job **jobs;
+    u32       len;
+    u32       cap; // Maximum amount of jobs
+} Png_Pool;
+
+// Pixel buffer object, that a frame is read into
+typedef struct {
+    u32   pbo;
+    u32   size;   // Bytes allocated for the PBO
+    void *fence;  // Signaled once the GPU finished writing the pixels
+    i32   width;
+    i32   height;
+} Readback_Buffer;
+
+// Reads frames back from the GPU without waiting for it
+// @Note: Starting a read only queues the copy into a PBO, whose pixels are copied out on a later frame, once the GPU got to it
+typedef struct {
+    Readback_Buffer buffers[READBACK_BUFFERS];
+    u32             first;   // Oldest read in flight
+    u32             pending; // Reads in flight
+} Gpu_Readback;
+
+bool readbackStart(Gpu_Readback *rb, u32 framebuffer, i32 width, i32 height); // Returns false while all buffers are in flight
+bool readbackPoll(Gpu_Readback *rb, bool wait, i32 *width, i32 *height);      // Returns whether the oldest read can be finished without waiting, unless wait is set
+void readbackFinish(Gpu_Readback *rb, u8 *pixels, bool flip);                 // Discards the oldest read if pixels is NULL
+void readbackFree(Gpu_Readback *rb);
+bool gifRecorderStart(Gif_Recorder *rec, const char *path, i32 width, i32 height); // Returns false if the previous recording is still being encoded
+bool gifRecorderRecording(const Gif_Recorder *rec);
+bool gifRecorderDue(Gif_Recorder *rec, float dt);
+u8  *gifRecorderAcquire(Gif_Recorder *rec, i32 width, i32 height);
+void gifRecorderPublish(Gif_Recorder *rec);
+void gifRecorderStop(Gif_Recorder *rec);
+void gifRecorderUpdate(Gif_Recorder *rec);
+void gifRecorderFree(Gif_Recorder *rec);
+bool frameStreamOpen(Frame_Stream *stream, const char *path, Stream_Format format, i32 width, i32 height, i32 fps); // Writes to stdout if path is "-"
+bool frameStreamDue(Frame_Stream *stream, float dt);
+u8  *frameStreamAcquire(Frame_Stream *stream, bool wait);
+void frameStreamPublish(Frame_Stream *stream);
+void frameStreamClose(Frame_Stream *stream);
+Png_Job *pngPoolAcquire(Png_Pool *pool, i32 width, i32 height);
+void     pngPoolSave(Png_Job *job);
+void     pngPoolWait(Png_Pool *pool);
+void     pngPoolFree(Png_Pool *pool);
+
+#endif // _CAPTURE_H_
@@ -0,0 +1,146 @@
+#include "density.h"
+#include "jobs.h"
+#include <math.h>
+
+#define DENSITY_PEAK_STRIDE 16         // Floats between the peaks of two threads, which puts them on separate cache lines
+#define DENSITY_MIN_HITS    (1/256.0f) // Bins that faded below this are cleared, so they don't decay into slow denormal floats
+
+void densityInit(Density_Map *map, i32 width, i32 height)
+{
+    *map = (Density_Map){0};
+    map->width   = width;
+    map->height  = height;
+    map->threads = jobsThreadCount();
+    map->hists   = calloc((size_t)map->threads*4*width*height, sizeof(float));
+    map->touched = calloc(map->threads, sizeof(bool));
+    map->merged  = calloc((size_t)4*width*height, sizeof(float));
+    map->peaks   = calloc(map->threads*DENSITY_PEAK_STRIDE, sizeof(float));
+    map->peak    = DENSITY_MIN_PEAK;
+}
+
+typedef struct {
+    Density_Map      *map;
+    const Line_Batch *batch;
+} Density_Splat_Job;
+
+static void splatBin(float *bin, Color c, float weight)
+{
+    bin[0] += weight*c.r;
+    bin[1] += weight*c.g;
+    bin[2] += weight*c.b;
+    bin[3] += weight;
+}
+
+static void splatLines(void *arg, u32 from, u32 to, u32 thread)
+{
+    Density_Splat_Job *job = arg;
+    Density_Map *map   = job->map;
+    i32          width = map->width;
+    float       *hist  = &map->hists[(size_t)thread*4*width*map->height];
+    bool         hit   = false;
+    for (u32 i = from; i < to; i++) {
+        Color c = job->batch->colors[i];
+        if (!c.a) continue;
+        Vector2 a  = job->batch->points[2*i];
+        Vector2 b  = job->batch->points[2*i + 1];
+        float   dx = b.x - a.x;
+        float   dy = b.y - a.y;
+        u32     n  = (u32)AIL_CLAMP(ceilf(AIL_MAX(fabsf(dx), fabsf(dy))), 1.0f, (float)DENSITY_MAX_SPLATS);
+        // @Note: Every line adds up to a single hit, so the density measures how long particles stay in a pixel, no matter how fast they move
+        float   w  = c.a/(255.0f*n);
+        for (u32 k = 1; k <= n; k++) {
+            // Coordinates are shifted by half a pixel, so each point is spread bilinearly over the 4 pixel centers around it
+            float x = a.x + dx*k/n - 0.5f;
+            float y = a.y + dy*k/n - 0.5f;
+            if (!(x >= 0 && y >= 0 && x < width - 1 && y < map->height - 1)) continue;
+            i32    x0  = (i32)x;
+            i32    y0  = (i32)y;
+            float  fx  = x - x0;
+            float  fy  = y - y0;
+            float *bin = &hist[4*(y0*width + x0)];
+            splatBin(bin,               c, w*(1 - fx)*(1 - fy));
+            splatBin(bin + 4,           c, w*fx*(1 - fy));
+            splatBin(bin + 4*width,     c, w*(1 - fx)*fy);
+            splatBin(bin + 4*width + 4, c, w*fx*fy);
+            hit = true;
+        }
+    }
+    if (hit) map->touched[thread] = true;
+}
+
+// Adds the lines' points into the histogram of the thread that processes them
+void densitySplat(Density_Map *map, const Line_Batch *batch)
+{
+    Density_Splat_Job job = { .map = map, .batch = batch };
+    jobsParallelFor(splatLines, &job, batch->len, 4096);
+}
+
+typedef struct {
+    Density_Map *map;
+    float        retain;
+    float        invLogPeak;
+    Color       *out;
+} Density_Resolve_Job;
+
+static void resolveRows(void *arg, u32 from, u32 to, u32 thread)
+{
+    Density_Resolve_Job *job = arg;
+    Density_Map *map    = job->map;
+    size_t       size   = (size_t)4*map->width*map->height;
+    u32          begin  = 4*from*map->width;
+    u32          end    = 4*to*map->width;
+    float       *merged = map->merged;
+    for (u32 i = begin; i < end; i++) merged[i] *= job->retain;
+    for (u32 t = 0; t < map->threads; t++) {
+        if (!map->touched[t]) continue;
+        float *hist = &map->hists[t*size];
+        for (u32 i = begin; i < end; i++) {
+            merged[i] += hist[i];
+            hist[i]    = 0;
+        }
+    }
+    float peak = map->peaks[thread*DENSITY_PEAK_STRIDE];
+    for (u32 i = begin; i < end; i += 4) {
+        float hits = merged[i + 3];
+        if (hits < DENSITY_MIN_HITS) {
+            merged[i + 0] = merged[i + 1] = merged[i + 2] = merged[i + 3] = 0;
+            job->out[i/4] = BLACK;
+            continue;
+        }
+        peak = AIL_MAX(peak, hits);
+        // Log-density keeps the structure of sparse regions visible next to pixels, that millions of particles pass through
+        // The brightness is applied to the average color of the hits, so colors don't saturate to white where particles pile up
+        float scale = AIL_MIN(log1pf(hits)*job->invLogPeak, 1.0f)/hits;
+        job->out[i/4] = (Color){ merged[i]*scale + 0.5f, merged[i + 1]*scale + 0.5f, merged[i + 2]*scale + 0.5f, 255 };
+    }
+    map->peaks[thread*DENSITY_PEAK_STRIDE] = peak;
+}
+
+// Fades the previous hits by retain, merges the histograms of all threads into them and tone maps the result into out, which needs to hold width*height pixels
+// @Note: The densities are normalized by the peak of the previous frames, so merging and tone mapping only need a single pass over the pixels
+void densityResolve(Density_Map *map, float retain, Color *out)
+{
+    for (u32 t = 0; t < map->threads; t++) map->peaks[t*DENSITY_PEAK_STRIDE] = 0;
+    Density_Resolve_Job job = {
+        .map        = map,
+        .retain     = AIL_CLAMP(retain, 0.0f, 1.0f),
+        .invLogPeak = 1.0f/log1pf(map->peak),
+        .out        = out,
+    };
+    jobsParallelFor(resolveRows, &job, map->height, 8);
+    for (u32 t = 0; t < map->threads; t++) map->touched[t] = false;
+
+    float peak = DENSITY_MIN_PEAK;
+    for (u32 t = 0; t < map->threads; t++) peak = AIL_MAX(peak, map->peaks[t*DENSITY_PEAK_STRIDE]);
+    // @Note: The peak only falls slowly, so the brightness doesn't flicker when a dense spot disappears
+    map->peak = peak >= map->peak ? peak : AIL_LERP(DENSITY_PEAK_FALLOFF, map->peak, peak);
+}
+
+void densityFree(Density_Map *map)
+{
+    free(map->hists);
+    free(map->touched);
+    free(map->merged);
+    free(map->peaks);
+    *map = (Density_Map){0};
+}
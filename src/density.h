@@ -0,0 +1,33 @@
+#ifndef _DENSITY_H_
+#define _DENSITY_H_
+
+#define  AIL_ALL_IMPL
+#include "ail.h"
+#include <stdbool.h>
+#include "raylib.h"
+#include "particles.h"
+
+#define DENSITY_MAX_SPLATS    4     // Points splatted along a line at most, so fast particles leave a trail instead of separate dots
+#define DENSITY_PEAK_FALLOFF  0.05f // Share by which the peak moves towards a lower density per frame. Higher densities are followed right away
+#define DENSITY_MIN_PEAK      4.0f  // Lowest peak the densities are normalized by, so a sparse field doesn't get blown out
+
+// Histogram of how often particles passed every pixel, which is tone mapped into a frame instead of drawing lines
+// Every thread splats into its own histogram, which are then summed up in parallel over the pixels, so no atomics are needed
+// @Note: Hits fade out like the lines of the accumulation buffer, so a pixel's density counts the particles of the last few frames
+typedef struct {
+    i32    width;
+    i32    height;
+    u32    threads;
+    float *hists;   // threads histograms of width*height bins, each holding the red, green & blue sums of the splatted colors and the hits
+    bool  *touched; // Whether the thread's histogram has hits, that weren't merged yet
+    float *merged;  // Decayed sum of all histograms
+    float *peaks;   // Highest density every thread saw while merging, padded to separate cache lines
+    float  peak;    // Density that is mapped to full brightness
+} Density_Map;
+
+void densityInit(Density_Map *map, i32 width, i32 height);
+void densitySplat(Density_Map *map, const Line_Batch *batch);
+void densityResolve(Density_Map *map, float retain, Color *out);
+void densityFree(Density_Map *map);
+
+#endif // _DENSITY_H_
@@ -0,0 +1,802 @@
+#include "field.h"
+#include "jobs.h"
+
+// Converts screen coordinates into the coordinates that the user's function receives
+Vector2 screenToFunc(float x, float y, float zoom, i32 width, i32 height)
+{
+    return (Vector2) {
+        .x = 2*zoom*x/width  - zoom,
+        .y = 2*zoom*y/height - zoom,
+    };
+}
+
+Vector2 clampFieldValue(Vector2 v)
+{
+    return (Vector2) {
+        .x = AIL_CLAMP(v.x, -FIELD_MAX_COMP, FIELD_MAX_COMP),
+        .y = AIL_CLAMP(v.y, -FIELD_MAX_COMP, FIELD_MAX_COMP),
+    };
+}
+
+static Vector2 evalClamped(IR func, float x, float y, float zoom, i32 width, i32 height)
+{
+    IR_Eval_Res res = evalUserFunc(func, screenToFunc(x, y, zoom, width, height));
+    return res.succ ? clampFieldValue(res.val.v) : (Vector2){0};
+}
+
+static Vector2 bilerp(const Vector2 corners[4], float tx, float ty)
+{
+    Vector2 top = { AIL_LERP(tx, corners[0].x, corners[1].x), AIL_LERP(tx, corners[0].y, corners[1].y) };
+    Vector2 bot = { AIL_LERP(tx, corners[2].x, corners[3].x), AIL_LERP(tx, corners[2].y, corners[3].y) };
+    return (Vector2){ AIL_LERP(ty, top.x, bot.x), AIL_LERP(ty, top.y, bot.y) };
+}
+
+// Moves the largest subtrees of node, that only depend on the position, into the grid's channels
+// @Note: Single positions aren't worth a channel, since reading them is as cheap as reading the channel
+static void splitGridChannels(Field_Grid *grid, IR *node)
+{
+    if (grid->channels == FIELD_GRID_MAX_CHANNELS) return;
+    if (node->deps == IR_DEP_XY && node->children.len > 0) {
+        grid->channelFuncs[grid->channels] = *node;
+        *node = (IR){ .inst = IR_INST_CHANNEL, .type = node->type, .deps = IR_DEP_XY, .val = {.i = grid->channels}, .children = ail_da_new_empty(IR) };
+        grid->channels++;
+        return;
+    }
+    if (!(node->deps & IR_DEP_XY)) return;
+    for (u32 i = 0; i < node->children.len; i++) splitGridChannels(grid, &node->children.data[i]);
+}
+
+static void freeGridChannels(Field_Grid *grid)
+{
+    if (!grid->animated) return;
+    for (u32 i = 0; i < grid->channels; i++) freeIR(&grid->channelFuncs[i]);
+    timeFoldFree(&grid->fold);
+    grid->channels = 0;
+    grid->animated = false;
+}
+
+typedef struct {
+    Field_Grid *grid;
+    i32         stride;
+    u32         firstRow; // Index of the first row within the pass
+} Field_Grid_Pass;
+
+static void sampleGridPassRows(void *arg, u32 from, u32 to, u32 thread)
+{
+    (void)thread;
+    Field_Grid_Pass *pass = arg;
+    Field_Grid      *grid = pass->grid;
+    i32 stride = pass->stride;
+    for (u32 i = pass->firstRow + from; i < pass->firstRow + to; i++) {
+        i32 r = i*stride;
+        // Every other sample of every other row was already taken by the previous pass
+        bool sampledBefore = stride < FIELD_GRID_MAX_STRIDE && r % (2*stride) == 0;
+        i32  step          = sampledBefore ? 2*stride : stride;
+        for (i32 c = sampledBefore ? stride : 0; c < grid->cols; c += step) {
+            if (!grid->animated) {
+                grid->samples[r*grid->cols + c] = evalClamped(grid->func, c*FIELD_GRID_DIV, r*FIELD_GRID_DIV, grid->zoom, grid->width, grid->height);
+                continue;
+            }
+            Vector2      in = screenToFunc(c*FIELD_GRID_DIV, r*FIELD_GRID_DIV, grid->zoom, grid->width, grid->height);
+            IR_Eval_Res *s  = &grid->channelSamples[(r*grid->cols + c)*grid->channels];
+            for (u32 k = 0; k < grid->channels; k++) s[k] = evalUserFunc(grid->channelFuncs[k], in);
+        }
+    }
+}
+
+// Continues sampling the grid for at most `budget` seconds
+// If the function, zoom or screen size changed, any sampling in progress is cancelled and restarted
+// The coarsest pass is always completed immediately, so that the grid can be used right away
+// Returns whether the grid is complete
+bool fieldGridUpdate(Field_Grid *grid, IR func, u32 version, float zoom, i32 width, i32 height, double budget)
+{
+    if (!grid->samples || grid->version != version || grid->zoom != zoom || grid->width != width || grid->height != height) {
+        bool newFunc = !grid->samples || grid->version != version;
+        // @Note: The amount of cells is rounded up to a multiple of the coarsest stride, so every pass includes the last row & column
+        i32 cols = (width/FIELD_GRID_DIV   + FIELD_GRID_MAX_STRIDE)/FIELD_GRID_MAX_STRIDE*FIELD_GRID_MAX_STRIDE + 1;
+        i32 rows = (height/FIELD_GRID_DIV  + FIELD_GRID_MAX_STRIDE)/FIELD_GRID_MAX_STRIDE*FIELD_GRID_MAX_STRIDE + 1;
+        if (cols*rows != grid->cols*grid->rows) {
+            free(grid->samples);
+            grid->samples = malloc(cols*rows*sizeof(Vector2));
+        }
+        if (newFunc) {
+            freeGridChannels(grid);
+            if (func.deps & IR_DEP_T) {
+                grid->animated = true;
+                timeFoldInit(&grid->fold, func);
+                splitGridChannels(grid, &grid->fold.func);
+            }
+        }
+        if (cols*rows*grid->channels > grid->channelCap) {
+            free(grid->channelSamples);
+            grid->channelCap     = cols*rows*grid->channels;
+            grid->channelSamples = malloc(grid->channelCap*sizeof(IR_Eval_Res));
+        }
+        grid->func        = func;
+        grid->version     = version;
+        grid->zoom        = zoom;
+        grid->width       = width;
+        grid->height      = height;
+        grid->cols        = cols;
+        grid->rows        = rows;
+        grid->stride      = 0;
+        grid->passStride  = FIELD_GRID_MAX_STRIDE;
+        grid->passRow     = 0;
+        grid->frameStride = 0;
+    }
+
+    double start = getTimeSecs();
+    u32    batch = jobsThreadCount();
+    while (grid->passStride) {
+        u32 passRows = (grid->rows - 1)/grid->passStride + 1;
+        u32 n        = AIL_MIN(batch, passRows - grid->passRow);
+        Field_Grid_Pass pass = { .grid = grid, .stride = grid->passStride, .firstRow = grid->passRow };
+        double batchStart = getTimeSecs();
+        jobsParallelFor(sampleGridPassRows, &pass, n, 1);
+        double now = getTimeSecs();
+        grid->passRow += n;
+        if (grid->passRow == passRows) {
+            grid->stride     = grid->passStride;
+            grid->passStride = grid->passStride/2;
+            grid->passRow    = 0;
+            // Channels at finer strides would never be combined
+            if (grid->animated && grid->passStride < FIELD_GRID_TIME_STRIDE) grid->passStride = 0;
+        }
+        if (grid->stride && now - start >= budget) break;
+        // Size the next batch to fill the remaining budget
+        double perRow = (now - batchStart)/n;
+        double left   = budget - (now - start);
+        batch = perRow > 0 ? AIL_CLAMP(left/perRow, jobsThreadCount(), passRows) : 2*batch;
+    }
+    return !grid->passStride;
+}
+
+static void combineGridRows(void *arg, u32 from, u32 to, u32 thread)
+{
+    (void)thread;
+    Field_Grid *grid   = arg;
+    i32         stride = grid->frameStride;
+    for (u32 i = from; i < to; i++) {
+        i32 r = i*stride;
+        for (i32 c = 0; c < grid->cols; c += stride) {
+            i32 idx    = r*grid->cols + c;
+            irChannels = &grid->channelSamples[idx*grid->channels];
+            grid->samples[idx] = evalClamped(grid->fold.func, c*FIELD_GRID_DIV, r*FIELD_GRID_DIV, grid->zoom, grid->width, grid->height);
+        }
+    }
+}
+
+// Combines the channels of a function depending on time into the field at time t
+// Needs to be called every frame after fieldGridUpdate
+// @Note: The channels are only sampled down to FIELD_GRID_TIME_STRIDE, since the combined function is evaluated at every sample every frame
+void fieldGridUpdateTime(Field_Grid *grid, float t)
+{
+    if (!grid->animated || !grid->stride) return;
+    timeFoldUpdate(&grid->fold, t);
+    grid->frameStride = grid->stride;
+    jobsParallelFor(combineGridRows, grid, (grid->rows - 1)/grid->frameStride + 1, 1);
+}
+
+// Bilinearly interpolates the field at the screen coordinates (x, y)
+// Returns false if the coordinates lie outside of the grid
+bool fieldGridSample(const Field_Grid *grid, float x, float y, Vector2 *out)
+{
+    i32 stride = grid->animated ? grid->frameStride : grid->stride;
+    if (!stride) return false;
+    float fx = x/FIELD_GRID_DIV;
+    float fy = y/FIELD_GRID_DIV;
+    // @Note: Written in negated form, so NaN coordinates are rejected as well
+    if (!(fx >= 0 && fy >= 0 && fx < grid->cols - 1 && fy < grid->rows - 1)) return false;
+    // Only interpolate between samples of the completed passes
+    i32 c = (i32)fx/stride*stride;
+    i32 r = (i32)fy/stride*stride;
+    const Vector2 *s = &grid->samples[r*grid->cols + c];
+    Vector2 corners[4] = { s[0], s[stride], s[stride*grid->cols], s[stride*grid->cols + stride] };
+    *out = bilerp(corners, (fx - c)/stride, (fy - r)/stride);
+    return true;
+}
+
+void fieldGridFree(Field_Grid *grid)
+{
+    freeGridChannels(grid);
+    free(grid->samples);
+    free(grid->channelSamples);
+    *grid = (Field_Grid){0};
+}
+
+////////////////////
+// Quadtree
+////////////////////
+
+// The extra samples taken for each tile of a level, to check whether it needs to be refined
+typedef struct {
+    Vector2 top, left, center, right, bottom;
+    bool    refine;
+} Field_Tree_Probe;
+
+typedef struct {
+    Field_Quadtree   *tree;
+    Field_Tree_Probe *probes;
+    Rectangle        *bounds;
+    u32               first; // Index of the level's first node
+    u32               depth;
+} Field_Tree_Level;
+
+static bool exceedsTolerance(Vector2 actual, Vector2 expected)
+{
+    return fabsf(actual.x - expected.x) > FIELD_TREE_TOLERANCE || fabsf(actual.y - expected.y) > FIELD_TREE_TOLERANCE;
+}
+
+static void probeTreeLevel(void *arg, u32 from, u32 to, u32 thread)
+{
+    (void)thread;
+    Field_Tree_Level *level = arg;
+    Field_Quadtree   *tree  = level->tree;
+    for (u32 i = from; i < to; i++) {
+        const Vector2 *c = tree->nodes[level->first + i].corners;
+        Rectangle b = level->bounds[i];
+        Field_Tree_Probe p;
+        p.top    = evalClamped(tree->func, b.x + b.width/2, b.y,                tree->zoom, tree->width, tree->height);
+        p.left   = evalClamped(tree->func, b.x,             b.y + b.height/2,   tree->zoom, tree->width, tree->height);
+        p.center = evalClamped(tree->func, b.x + b.width/2, b.y + b.height/2,   tree->zoom, tree->width, tree->height);
+        p.right  = evalClamped(tree->func, b.x + b.width,   b.y + b.height/2,   tree->zoom, tree->width, tree->height);
+        p.bottom = evalClamped(tree->func, b.x + b.width/2, b.y + b.height,     tree->zoom, tree->width, tree->height);
+        p.refine = level->depth < FIELD_TREE_MIN_DEPTH
+                || exceedsTolerance(p.top,    bilerp(c, 0.5f, 0.0f))
+                || exceedsTolerance(p.left,   bilerp(c, 0.0f, 0.5f))
+                || exceedsTolerance(p.center, bilerp(c, 0.5f, 0.5f))
+                || exceedsTolerance(p.right,  bilerp(c, 1.0f, 0.5f))
+                || exceedsTolerance(p.bottom, bilerp(c, 0.5f, 1.0f));
+        level->probes[i] = p;
+    }
+}
+
+// Continues refining the quadtree for at most `budget` seconds
+// If the function, zoom or screen size changed, the quadtree is reset to a single tile and refined from scratch
+// Tiles are refined level by level, until their interpolation error is within tolerance or the depth or memory budget is exhausted
+// Returns whether the quadtree is complete
+bool fieldTreeUpdate(Field_Quadtree *tree, IR func, u32 version, float zoom, i32 width, i32 height, double budget)
+{
+    if (!tree->nodes || tree->version != version || tree->zoom != zoom || tree->width != width || tree->height != height) {
+        if (!tree->nodes) {
+            tree->cap        = 1024;
+            tree->nodes      = malloc(tree->cap*sizeof(Field_Tree_Node));
+            tree->bounds     = ail_da_new_with_cap(Rectangle, 1);
+            tree->nextBounds = ail_da_new_with_cap(Rectangle, 4);
+        }
+        tree->func       = func;
+        tree->version    = version;
+        tree->zoom       = zoom;
+        tree->width      = width;
+        tree->height     = height;
+        tree->len        = 1;
+        tree->leaves     = 1;
+        tree->depth      = 0;
+        tree->building   = true;
+        tree->levelFirst = 0;
+        tree->levelDone  = 0;
+        tree->nodes[0] = (Field_Tree_Node) {
+            .corners = {
+                evalClamped(func, 0,     0,      zoom, width, height),
+                evalClamped(func, width, 0,      zoom, width, height),
+                evalClamped(func, 0,     height, zoom, width, height),
+                evalClamped(func, width, height, zoom, width, height),
+            },
+            .children = 0,
+        };
+        // @Note: Bounds are only kept for the levels being refined, since lookups recompute them while traversing anyways
+        tree->bounds.len     = 0;
+        tree->nextBounds.len = 0;
+        ail_da_push(&tree->bounds, ((Rectangle){ 0, 0, width, height }));
+    }
+
+    double start  = getTimeSecs();
+    u32    batch  = 16*jobsThreadCount();
+    Field_Tree_Probe *probes = NULL;
+    while (tree->building) {
+        u32 n  = AIL_MIN(batch, tree->bounds.len - tree->levelDone);
+        probes = realloc(probes, n*sizeof(Field_Tree_Probe));
+        Field_Tree_Level level = {
+            .tree   = tree,
+            .probes = probes,
+            .bounds = tree->bounds.data + tree->levelDone,
+            .first  = tree->levelFirst + tree->levelDone,
+            .depth  = tree->depth,
+        };
+        double batchStart = getTimeSecs();
+        jobsParallelFor(probeTreeLevel, &level, n, 16);
+
+        for (u32 i = 0; i < n; i++) {
+            Field_Tree_Probe p = probes[i];
+            if (!p.refine || tree->len + 4 > FIELD_TREE_MAX_NODES) continue;
+            if (tree->len + 4 > tree->cap) {
+                tree->cap   = AIL_MIN(2*tree->cap, FIELD_TREE_MAX_NODES);
+                tree->nodes = realloc(tree->nodes, tree->cap*sizeof(Field_Tree_Node));
+            }
+            Field_Tree_Node *node = &tree->nodes[level.first + i];
+            const Vector2   *c    = node->corners;
+            u32 children = tree->len;
+            tree->nodes[tree->len++] = (Field_Tree_Node){ .corners = { c[0],     p.top,    p.left,   p.center }, .children = 0 };
+            tree->nodes[tree->len++] = (Field_Tree_Node){ .corners = { p.top,    c[1],     p.center, p.right  }, .children = 0 };
+            tree->nodes[tree->len++] = (Field_Tree_Node){ .corners = { p.left,   p.center, c[2],     p.bottom }, .children = 0 };
+            tree->nodes[tree->len++] = (Field_Tree_Node){ .corners = { p.center, p.right,  p.bottom, c[3]     }, .children = 0 };
+            tree->nodes[level.first + i].children = children;
+            tree->leaves += 3;
+            Rectangle b = level.bounds[i];
+            float w = b.width/2, h = b.height/2;
+            ail_da_push(&tree->nextBounds, ((Rectangle){ b.x,     b.y,     w, h }));
+            ail_da_push(&tree->nextBounds, ((Rectangle){ b.x + w, b.y,     w, h }));
+            ail_da_push(&tree->nextBounds, ((Rectangle){ b.x,     b.y + h, w, h }));
+            ail_da_push(&tree->nextBounds, ((Rectangle){ b.x + w, b.y + h, w, h }));
+        }
+        tree->levelDone += n;
+
+        if (tree->levelDone == tree->bounds.len) {
+            // The next level's nodes were appended right after the current level's nodes
+            tree->levelFirst += tree->bounds.len;
+            tree->levelDone   = 0;
+            AIL_DA(Rectangle) tmp = tree->bounds;
+            tree->bounds         = tree->nextBounds;
+            tree->nextBounds     = tmp;
+            tree->nextBounds.len = 0;
+            if (tree->bounds.len) tree->depth++;
+            tree->building = tree->bounds.len && tree->depth < FIELD_TREE_MAX_DEPTH;
+        }
+
+        double now = getTimeSecs();
+        if (now - start >= budget) break;
+        // Size the next batch to fill the remaining budget
+        double perNode = (now - batchStart)/n;
+        double left    = budget - (now - start);
+        batch = perNode > 0 ? AIL_CLAMP(left/perNode, jobsThreadCount(), FIELD_TREE_MAX_NODES) : 2*batch;
+    }
+    free(probes);
+    return !tree->building;
+}
+
+// Traverses the quadtree to the leaf containing the screen coordinates (x, y) and bilinearly interpolates its corners
+// Returns false if the coordinates lie outside of the quadtree
+bool fieldTreeSample(const Field_Quadtree *tree, float x, float y, Vector2 *out)
+{
+    if (!tree->nodes || !(x >= 0 && y >= 0 && x <= tree->width && y <= tree->height)) return false;
+    float tx = x/tree->width;
+    float ty = y/tree->height;
+    const Field_Tree_Node *node = &tree->nodes[0];
+    while (node->children) {
+        u32 idx = 0;
+        tx *= 2;
+        ty *= 2;
+        if (tx >= 1.0f) { idx += 1; tx -= 1.0f; }
+        if (ty >= 1.0f) { idx += 2; ty -= 1.0f; }
+        node = &tree->nodes[node->children + idx];
+    }
+    *out = bilerp(node->corners, tx, ty);
+    return true;
+}
+
+void fieldTreeFree(Field_Quadtree *tree)
+{
+    free(tree->nodes);
+    ail_da_free(&tree->bounds);
+    ail_da_free(&tree->nextBounds);
+    *tree = (Field_Quadtree){0};
+}
+
+////////////////////
+// Tile Cache
+////////////////////
+
+#define TILE_NONE UINT32_MAX
+#define TILE_SAMPLES_PER_ROW (FIELD_TILE_SIZE + 1)
+
+typedef enum {
+    FIELD_TILE_EMPTY,   // Not computed, e.g. because it was cancelled
+    FIELD_TILE_PENDING, // Waiting to be computed in the background
+    FIELD_TILE_READY,
+} Field_Tile_State;
+
+struct Field_Tile {
+    Field_Tile_Cache *cache;
+    IR         func;
+    u64        funcHash;
+    i32        level;
+    i32        tx;
+    i32        ty;
+    float      spacing;    // Distance between two samples in the function's coordinate space
+    atomic_int state;
+    u32        lruPrev;
+    u32        lruNext;
+    u32        bucketNext;
+    Vector2    samples[TILE_SAMPLES_PER_ROW*TILE_SAMPLES_PER_ROW];
+};
+
+static i32 floorDiv(i32 a, i32 b)
+{
+    return a/b - (a % b != 0 && (a < 0) != (b < 0));
+}
+
+static u32 tileBucket(u64 funcHash, i32 level, i32 tx, i32 ty)
+{
+    u64 h = funcHash;
+    h = (h ^ (u32)level) * 0x9e3779b97f4a7c15;
+    h = (h ^ (u32)tx)    * 0x9e3779b97f4a7c15;
+    h = (h ^ (u32)ty)    * 0x9e3779b97f4a7c15;
+    return (h >> 32) % FIELD_TILE_BUCKETS;
+}
+
+static void computeTile(void *arg)
+{
+    Field_Tile       *tile  = arg;
+    Field_Tile_Cache *cache = tile->cache;
+    // Skip tiles that became useless while they were waiting, e.g. because the user zoomed past them
+    i32 wantedLevel = atomic_load(&cache->wantedLevel);
+    if (tile->funcHash != atomic_load(&cache->wantedHash) || tile->level < wantedLevel || tile->level > wantedLevel + FIELD_TILE_FALLBACKS) {
+        atomic_store(&tile->state, FIELD_TILE_EMPTY);
+        atomic_fetch_sub(&cache->pending, 1);
+        return;
+    }
+    for (i32 r = 0; r < TILE_SAMPLES_PER_ROW; r++) {
+        for (i32 c = 0; c < TILE_SAMPLES_PER_ROW; c++) {
+            Vector2 in = { (tile->tx*FIELD_TILE_SIZE + c)*tile->spacing, (tile->ty*FIELD_TILE_SIZE + r)*tile->spacing };
+            IR_Eval_Res res = evalUserFunc(tile->func, in);
+            tile->samples[r*TILE_SAMPLES_PER_ROW + c] = res.succ ? clampFieldValue(res.val.v) : (Vector2){0};
+        }
+    }
+    atomic_store(&tile->state, FIELD_TILE_READY);
+    atomic_fetch_sub(&cache->pending, 1);
+}
+
+static void lruUnlink(Field_Tile_Cache *cache, u32 idx)
+{
+    Field_Tile *tile = cache->tiles[idx];
+    if (tile->lruPrev != TILE_NONE) cache->tiles[tile->lruPrev]->lruNext = tile->lruNext;
+    else                            cache->lruHead = tile->lruNext;
+    if (tile->lruNext != TILE_NONE) cache->tiles[tile->lruNext]->lruPrev = tile->lruPrev;
+    else                            cache->lruTail = tile->lruPrev;
+}
+
+static void lruPushFront(Field_Tile_Cache *cache, u32 idx)
+{
+    Field_Tile *tile = cache->tiles[idx];
+    tile->lruPrev = TILE_NONE;
+    tile->lruNext = cache->lruHead;
+    if (cache->lruHead != TILE_NONE) cache->tiles[cache->lruHead]->lruPrev = idx;
+    cache->lruHead = idx;
+    if (cache->lruTail == TILE_NONE) cache->lruTail = idx;
+}
+
+static void lruTouch(Field_Tile_Cache *cache, u32 idx)
+{
+    if (cache->lruHead == idx) return;
+    lruUnlink(cache, idx);
+    lruPushFront(cache, idx);
+}
+
+static u32 findTile(const Field_Tile_Cache *cache, u64 funcHash, i32 level, i32 tx, i32 ty)
+{
+    u32 idx = cache->buckets[tileBucket(funcHash, level, tx, ty)];
+    while (idx != TILE_NONE) {
+        const Field_Tile *tile = cache->tiles[idx];
+        if (tile->funcHash == funcHash && tile->level == level && tile->tx == tx && tile->ty == ty) break;
+        idx = tile->bucketNext;
+    }
+    return idx;
+}
+
+static void removeFromBucket(Field_Tile_Cache *cache, u32 idx)
+{
+    Field_Tile *tile = cache->tiles[idx];
+    u32 *link = &cache->buckets[tileBucket(tile->funcHash, tile->level, tile->tx, tile->ty)];
+    while (*link != idx) link = &cache->tiles[*link]->bucketNext;
+    *link = tile->bucketNext;
+}
+
+// Returns the index of a tile slot that can be (re-)used or TILE_NONE if all tiles are in use
+static u32 allocTile(Field_Tile_Cache *cache)
+{
+    if (cache->len < cache->cap) {
+        u32 idx = cache->len++;
+        cache->tiles[idx] = malloc(sizeof(Field_Tile));
+        lruPushFront(cache, idx);
+        return idx;
+    }
+    // Evict the least recently used tile, that isn't currently being computed
+    for (u32 idx = cache->lruTail; idx != TILE_NONE; idx = cache->tiles[idx]->lruPrev) {
+        if (atomic_load(&cache->tiles[idx]->state) == FIELD_TILE_PENDING) continue;
+        removeFromBucket(cache, idx);
+        lruTouch(cache, idx);
+        return idx;
+    }
+    return TILE_NONE;
+}
+
+static void requestTile(Field_Tile_Cache *cache, u32 idx)
+{
+    atomic_store(&cache->tiles[idx]->state, FIELD_TILE_PENDING);
+    atomic_fetch_add(&cache->pending, 1);
+    if (!jobsBackground(computeTile, cache->tiles[idx])) {
+        atomic_store(&cache->tiles[idx]->state, FIELD_TILE_EMPTY);
+        atomic_fetch_sub(&cache->pending, 1);
+    }
+}
+
+// Returns the tile at the given key if it is ready. Missing tiles are requested to be computed in the background, if request is true
+static Field_Tile *getTile(Field_Tile_Cache *cache, i32 level, i32 tx, i32 ty, bool request)
+{
+    u32 idx = findTile(cache, cache->funcHash, level, tx, ty);
+    if (idx != TILE_NONE) {
+        Field_Tile *tile = cache->tiles[idx];
+        lruTouch(cache, idx);
+        i32 state = atomic_load(&tile->state);
+        if (state == FIELD_TILE_READY) return tile;
+        if (state == FIELD_TILE_EMPTY && request && atomic_load(&cache->pending) < FIELD_TILE_MAX_PENDING) requestTile(cache, idx);
+        return NULL;
+    }
+    if (!request || atomic_load(&cache->pending) >= FIELD_TILE_MAX_PENDING) return NULL;
+
+    idx = allocTile(cache);
+    if (idx == TILE_NONE) return NULL;
+    Field_Tile *tile = cache->tiles[idx];
+    tile->cache    = cache;
+    tile->func     = cache->func;
+    tile->funcHash = cache->funcHash;
+    tile->level    = level;
+    tile->tx       = tx;
+    tile->ty       = ty;
+    tile->spacing  = ldexpf(1.0f, level);
+    u32 *bucket = &cache->buckets[tileBucket(tile->funcHash, level, tx, ty)];
+    tile->bucketNext = *bucket;
+    *bucket = idx;
+    requestTile(cache, idx);
+    return NULL;
+}
+
+// Picks the zoom level for the current zoom and screen size and collects the tiles covering the screen
+// Missing tiles are computed in the background, while tiles of coarser levels are used in the meantime
+void fieldTilesUpdate(Field_Tile_Cache *cache, IR func, u64 funcHash, float zoom, i32 width, i32 height)
+{
+    if (!cache->tiles) {
+        cache->cap     = FIELD_TILE_MEMORY/sizeof(Field_Tile);
+        cache->tiles   = calloc(cache->cap, sizeof(Field_Tile *));
+        cache->buckets = malloc(FIELD_TILE_BUCKETS*sizeof(u32));
+        for (u32 i = 0; i < FIELD_TILE_BUCKETS; i++) cache->buckets[i] = TILE_NONE;
+        cache->lruHead = TILE_NONE;
+        cache->lruTail = TILE_NONE;
+    }
+    // The spacing between samples is the largest power of two, that is at most FIELD_TILE_DIV pixels on screen
+    float maxSpacing = FIELD_TILE_DIV*2*zoom/AIL_MAX(width, height);
+    cache->func       = func;
+    cache->funcHash   = funcHash;
+    cache->zoom       = zoom;
+    cache->width      = width;
+    cache->height     = height;
+    cache->level      = (i32)floorf(log2f(maxSpacing));
+    cache->tileExtent = FIELD_TILE_SIZE*ldexpf(1.0f, cache->level);
+    atomic_store(&cache->wantedHash,  funcHash);
+    atomic_store(&cache->wantedLevel, cache->level);
+
+    cache->viewX    = (i32)floorf(-zoom/cache->tileExtent);
+    cache->viewY    = cache->viewX;
+    cache->viewCols = (i32)floorf(zoom/cache->tileExtent) - cache->viewX + 1;
+    cache->viewRows = cache->viewCols;
+    u32 viewLen = cache->viewCols*cache->viewRows;
+    if (viewLen > cache->viewCap) {
+        cache->viewCap = viewLen;
+        cache->view    = realloc(cache->view, viewLen*sizeof(Field_Tile *));
+    }
+
+    cache->viewFallbacks = 0;
+    cache->viewMissing   = 0;
+    for (i32 r = 0; r < cache->viewRows; r++) {
+        for (i32 c = 0; c < cache->viewCols; c++) {
+            i32 tx = cache->viewX + c;
+            i32 ty = cache->viewY + r;
+            Field_Tile *tile = getTile(cache, cache->level, tx, ty, true);
+            for (i32 l = 1; !tile && l <= FIELD_TILE_FALLBACKS; l++) {
+                tile = getTile(cache, cache->level + l, floorDiv(tx, 1 << l), floorDiv(ty, 1 << l), false);
+                if (tile) cache->viewFallbacks++;
+            }
+            if (!tile) cache->viewMissing++;
+            cache->view[r*cache->viewCols + c] = tile;
+        }
+    }
+}
+
+// Bilinearly interpolates the field at the screen coordinates (x, y) from the best available tile
+// Returns false if no tile is available there yet
+bool fieldTilesSample(const Field_Tile_Cache *cache, float x, float y, Vector2 *out)
+{
+    Vector2 p = screenToFunc(x, y, cache->zoom, cache->width, cache->height);
+    // @Note: The bounds are checked before converting to integers, so NaN and huge coordinates are rejected as well
+    float fc = floorf(p.x/cache->tileExtent) - cache->viewX;
+    float fr = floorf(p.y/cache->tileExtent) - cache->viewY;
+    if (!(fc >= 0 && fr >= 0 && fc < cache->viewCols && fr < cache->viewRows)) return false;
+    i32 c = (i32)fc;
+    i32 r = (i32)fr;
+    const Field_Tile *tile = cache->view[r*cache->viewCols + c];
+    if (!tile) return false;
+
+    float fx = p.x/tile->spacing - tile->tx*FIELD_TILE_SIZE;
+    float fy = p.y/tile->spacing - tile->ty*FIELD_TILE_SIZE;
+    i32 sc = AIL_CLAMP((i32)fx, 0, FIELD_TILE_SIZE - 1);
+    i32 sr = AIL_CLAMP((i32)fy, 0, FIELD_TILE_SIZE - 1);
+    const Vector2 *s = &tile->samples[sr*TILE_SAMPLES_PER_ROW + sc];
+    Vector2 corners[4] = { s[0], s[1], s[TILE_SAMPLES_PER_ROW], s[TILE_SAMPLES_PER_ROW + 1] };
+    *out = bilerp(corners, fx - sc, fy - sr);
+    return true;
+}
+
+// @Note: Waits for all pending tiles, since background tasks might still be writing to them
+void fieldTilesFree(Field_Tile_Cache *cache)
+{
+    atomic_store(&cache->wantedHash, 0);
+    while (atomic_load(&cache->pending)) sleepSecs(FIELD_WAIT_SLEEP_MS/1000.0f);
+    for (u32 i = 0; i < cache->len; i++) free(cache->tiles[i]);
+    free(cache->tiles);
+    free(cache->buckets);
+    free(cache->view);
+    *cache = (Field_Tile_Cache){0};
+}
+
+////////////////////
+// Displacements
+////////////////////
+
+typedef struct {
+    Field_Flow_Map *map;
+    i32             firstRow;
+} Field_Flow_Band;
+
+struct Field_Flow_Map {
+    IR       func;
+    u32      version;
+    float    zoom;
+    i32      width;
+    i32      height;
+    i32      cols;
+    i32      rows;
+    Vector2 *samples; // Value of the function at every sample
+    Vector2 *moves;   // Displacement of a particle starting at every sample within one frame
+    Field_Flow_Band *bands;
+    atomic_uint bandsDone;
+    atomic_uint pending;   // Amount of bands, that were queued but didn't finish yet
+    atomic_bool cancelled;
+    Field_Flow_Map *next;
+};
+
+// A particle moves by half the field's value per frame (see particlesStep)
+static Vector2 flowVelocity(const Field_Flow_Map *map, Vector2 p)
+{
+    Vector2 v = evalClamped(map->func, p.x, p.y, map->zoom, map->width, map->height);
+    return (Vector2){ v.x/2.0f, v.y/2.0f };
+}
+
+static Vector2 integrateFlow(const Field_Flow_Map *map, Vector2 p)
+{
+    Vector2 start = p;
+    float   h     = 1.0f/FIELD_FLOW_SUBSTEPS;
+    for (i32 i = 0; i < FIELD_FLOW_SUBSTEPS; i++) {
+        Vector2 k1 = flowVelocity(map, p);
+        Vector2 k2 = flowVelocity(map, (Vector2){ p.x + h/2*k1.x, p.y + h/2*k1.y });
+        Vector2 k3 = flowVelocity(map, (Vector2){ p.x + h/2*k2.x, p.y + h/2*k2.y });
+        Vector2 k4 = flowVelocity(map, (Vector2){ p.x + h*k3.x,   p.y + h*k3.y });
+        p.x += h/6*(k1.x + 2*k2.x + 2*k3.x + k4.x);
+        p.y += h/6*(k1.y + 2*k2.y + 2*k3.y + k4.y);
+    }
+    return (Vector2){ p.x - start.x, p.y - start.y };
+}
+
+static void computeFlowBand(void *arg)
+{
+    Field_Flow_Band *band = arg;
+    Field_Flow_Map  *map  = band->map;
+    if (!atomic_load(&map->cancelled)) {
+        i32 lastRow = AIL_MIN(band->firstRow + FIELD_FLOW_BAND, map->rows);
+        for (i32 r = band->firstRow; r < lastRow; r++) {
+            for (i32 c = 0; c < map->cols; c++) {
+                float x = c*FIELD_FLOW_DIV;
+                float y = r*FIELD_FLOW_DIV;
+                map->samples[r*map->cols + c] = evalClamped(map->func, x, y, map->zoom, map->width, map->height);
+                map->moves[r*map->cols + c]   = integrateFlow(map, (Vector2){ x, y });
+            }
+        }
+        atomic_fetch_add(&map->bandsDone, 1);
+    }
+    atomic_fetch_sub(&map->pending, 1);
+}
+
+static void freeFlowMap(Field_Flow_Map *map)
+{
+    free(map->samples);
+    free(map->moves);
+    free(map->bands);
+    free(map);
+}
+
+// Starts building a new map if the function, zoom or screen size changed and hands bands to the background workers, as long as they accept them
+// @Note: Only meant for functions that don't depend on time
+void fieldFlowUpdate(Field_Flow_Cache *cache, IR func, u32 version, float zoom, i32 width, i32 height)
+{
+    Field_Flow_Map *map = cache->map;
+    if (!map || map->version != version || map->zoom != zoom || map->width != width || map->height != height) {
+        if (map) {
+            atomic_store(&map->cancelled, true);
+            map->next      = cache->retired;
+            cache->retired = map;
+        }
+        map = calloc(1, sizeof(Field_Flow_Map));
+        map->func    = func;
+        map->version = version;
+        map->zoom    = zoom;
+        map->width   = width;
+        map->height  = height;
+        // @Note: One extra sample per row & column, so that the last pixels can be interpolated as well
+        map->cols    = width/FIELD_FLOW_DIV  + 2;
+        map->rows    = height/FIELD_FLOW_DIV + 2;
+        map->samples = malloc(map->cols*map->rows*sizeof(Vector2));
+        map->moves   = malloc(map->cols*map->rows*sizeof(Vector2));
+        cache->map    = map;
+        cache->bands  = (map->rows + FIELD_FLOW_BAND - 1)/FIELD_FLOW_BAND;
+        cache->queued = 0;
+        map->bands    = malloc(cache->bands*sizeof(Field_Flow_Band));
+    }
+    while (cache->queued < cache->bands) {
+        Field_Flow_Band *band = &map->bands[cache->queued];
+        *band = (Field_Flow_Band){ .map = map, .firstRow = cache->queued*FIELD_FLOW_BAND };
+        atomic_fetch_add(&map->pending, 1);
+        if (!jobsBackground(computeFlowBand, band)) {
+            atomic_fetch_sub(&map->pending, 1);
+            break;
+        }
+        cache->queued++;
+    }
+    for (Field_Flow_Map **link = &cache->retired; *link;) {
+        Field_Flow_Map *old = *link;
+        if (atomic_load(&old->pending)) {
+            link = &old->next;
+            continue;
+        }
+        *link = old->next;
+        freeFlowMap(old);
+    }
+}
+
+bool fieldFlowReady(const Field_Flow_Cache *cache)
+{
+    return cache->map && atomic_load(&cache->map->bandsDone) == cache->bands;
+}
+
+// Bilinearly interpolates the field and the displacement of a particle within one frame at the screen coordinates (x, y)
+// Returns false if the map isn't complete yet
+bool fieldFlowSample(const Field_Flow_Cache *cache, float x, float y, Vector2 *out, Vector2 *move)
+{
+    if (!fieldFlowReady(cache) || !(isfinite(x) && isfinite(y))) return false;
+    const Field_Flow_Map *map = cache->map;
+    float fx = x/FIELD_FLOW_DIV;
+    float fy = y/FIELD_FLOW_DIV;
+    i32 c = (i32)AIL_CLAMP(fx, 0.0f, map->cols - 2.0f);
+    i32 r = (i32)AIL_CLAMP(fy, 0.0f, map->rows - 2.0f);
+    i32 i = r*map->cols + c;
+    Vector2 samples[4] = { map->samples[i], map->samples[i + 1], map->samples[i + map->cols], map->samples[i + map->cols + 1] };
+    Vector2 moves[4]   = { map->moves[i],   map->moves[i + 1],   map->moves[i + map->cols],   map->moves[i + map->cols + 1] };
+    *out  = bilerp(samples, fx - c, fy - r);
+    *move = bilerp(moves,   fx - c, fy - r);
+    return true;
+}
+
+// @Note: Waits for all pending bands, since background tasks might still be writing to the maps
+void fieldFlowFree(Field_Flow_Cache *cache)
+{
+    if (cache->map) {
+        atomic_store(&cache->map->cancelled, true);
+        cache->map->next = cache->retired;
+        cache->retired   = cache->map;
+    }
+    while (cache->retired) {
+        Field_Flow_Map *map = cache->retired;
+        while (atomic_load(&map->pending)) sleepSecs(FIELD_WAIT_SLEEP_MS/1000.0f);
+        cache->retired = map->next;
+        freeFlowMap(map);
+    }
+    *cache = (Field_Flow_Cache){0};
+}
@@ -0,0 +1,159 @@
+#ifndef _FIELD_H_
+#define _FIELD_H_
+
+#define  AIL_ALL_IMPL
+#include "ail.h"
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "raylib.h"
+#include "ir.h"
+
+#define FIELD_GRID_DIV          2 // Distance in pixels between two neighbouring samples of the grid
+#define FIELD_GRID_MAX_STRIDE   8 // Stride between the samples of the first and coarsest pass over the grid. Needs to be a power of two
+#define FIELD_GRID_TIME_STRIDE  2 // Finest stride of the grid for functions depending on time, whose samples are recombined every frame
+#define FIELD_GRID_MAX_CHANNELS 4 // Maximum amount of subtrees, that are cached per sample for functions depending on time
+#define FIELD_MAX_COMP  2 // Field values are clamped to [-FIELD_MAX_COMP, FIELD_MAX_COMP] per component
+
+#define FIELD_TREE_MIN_DEPTH 3         // Tiles are always refined up to this depth, so small features can't slip between the first samples
+#define FIELD_TREE_MAX_DEPTH 12
+#define FIELD_TREE_MAX_NODES (1 << 18) // Memory budget of the quadtree
+#define FIELD_TREE_TOLERANCE 0.05f     // Maximum interpolation error of a leaf tile (per component)
+
+#define FIELD_TILE_SIZE        32         // Cells per tile row/column. Tiles store (FIELD_TILE_SIZE + 1)^2 samples, so that they share their borders
+#define FIELD_TILE_DIV         3          // Maximum distance in pixels between two neighbouring samples of a tile
+#define FIELD_TILE_MEMORY      (64 << 20) // Memory budget of the tile cache in bytes
+#define FIELD_TILE_BUCKETS     4096       // Size of the tile cache's hash table
+#define FIELD_TILE_MAX_PENDING 512        // Maximum amount of tiles waiting to be computed in the background
+#define FIELD_TILE_FALLBACKS   4          // Amount of coarser levels that are searched while a tile is being computed
+#define FIELD_WAIT_SLEEP_MS    0.5f       // Time spent sleeping, while waiting for background tasks before freeing a cache
+
+#define FIELD_FLOW_DIV      4  // Distance in pixels between two neighbouring samples of the displacements
+#define FIELD_FLOW_SUBSTEPS 4  // RK4 steps that a frame of particle motion is integrated with
+#define FIELD_FLOW_BAND     16 // Rows of displacements computed per background task
+
+typedef enum {
+    FIELD_CACHE_NONE, // Evaluate the function for every particle
+    FIELD_CACHE_GRID, // Interpolate between samples on a uniform grid
+    FIELD_CACHE_TREE, // Interpolate between samples on an adaptively refined quadtree
+    FIELD_CACHE_TILE, // Interpolate between samples of tiles from a pyramid of power-of-two zoom levels
+    FIELD_CACHE_FLOW, // Interpolate between samples and precomputed particle displacements on a uniform grid
+    FIELD_CACHE_LEN,
+} Field_Cache_Mode;
+
+// Samples of the function on a uniform grid spanning the screen
+typedef struct {
+    IR       func;
+    u32      version; // Version of func, used to detect when the function changed
+    float    zoom;
+    i32      width;   // Width of the sampled screen area in pixels
+    i32      height;  // Height of the sampled screen area in pixels
+    i32      cols;    // Amount of samples per row
+    i32      rows;    // Amount of samples per column
+    Vector2 *samples; // For functions depending on time, only the samples combined for the current frame are valid
+    // Samples are taken in coarse-to-fine passes, each halving the stride between samples
+    i32      stride;     // Stride of the finest completed pass or 0 if none was completed yet
+    i32      passStride; // Stride of the pass in progress or 0 if the grid is complete
+    u32      passRow;    // Amount of the pass's rows that were already sampled
+    // For functions depending on time, the passes sample the largest subtrees that only depend on the position as channels instead
+    // Every frame, the rest of the function is evaluated once per sample, reading the channels in place of those subtrees
+    bool          animated;
+    IR_Time_Fold  fold; // func with the subtrees, that only depend on time, folded in. The channels' subtrees are replaced by IR_INST_CHANNEL
+    IR            channelFuncs[FIELD_GRID_MAX_CHANNELS];
+    u32           channels;
+    IR_Eval_Res  *channelSamples; // channels consecutive values per sample
+    u32           channelCap;     // Capacity of channelSamples in values
+    i32           frameStride;    // Stride of the samples combined for the current frame or 0 if none were combined yet
+} Field_Grid;
+
+AIL_DA_INIT(Rectangle);
+
+typedef struct {
+    Vector2 corners[4]; // Samples at the top-left, top-right, bottom-left & bottom-right corners
+    u32     children;   // Index of the first of four consecutive children (ordered like corners) or 0 for leaves
+} Field_Tree_Node;
+
+// Samples of the function on a quadtree spanning the screen, that is refined where interpolation would be inaccurate
+typedef struct {
+    IR       func;
+    u32      version; // Version of func, used to detect when the function changed
+    float    zoom;
+    i32      width;   // Width of the sampled screen area in pixels
+    i32      height;  // Height of the sampled screen area in pixels
+    Field_Tree_Node *nodes; // nodes[0] is the root
+    u32      len;
+    u32      cap;
+    u32      leaves;
+    u32      depth;
+    // Tiles are refined level by level, spread over several frames
+    bool     building;
+    u32      levelFirst; // Index of the first node of the level being refined
+    u32      levelDone;  // Amount of nodes of the level that were already probed
+    AIL_DA(Rectangle) bounds;     // Bounds of the nodes in the level being refined
+    AIL_DA(Rectangle) nextBounds; // Bounds of the nodes in the next level
+} Field_Quadtree;
+
+typedef struct Field_Tile Field_Tile;
+
+// LRU cache of fixed-size tiles, keyed by function hash, zoom level and tile coordinates
+// Tiles are aligned in the function's coordinate space, so that they can be reused while zooming
+// Tiles are computed in the background. Until then, a tile from a coarser level is used instead
+typedef struct {
+    Field_Tile **tiles;   // Pool of at most cap tiles; the indices in this pool identify tiles
+    u32          len;
+    u32          cap;
+    u32         *buckets; // Hash table of tile indices, chained via the tiles
+    u32          lruHead; // Most recently used tile
+    u32          lruTail; // Least recently used tile
+    atomic_uint  pending; // Amount of tiles waiting to be computed
+    // Tiles that are still wanted by background tasks
+    atomic_ullong wantedHash;
+    atomic_int    wantedLevel;
+    // View of the tiles covering the screen in the current frame
+    IR           func;
+    u64          funcHash;
+    float        zoom;
+    i32          width;
+    i32          height;
+    i32          level;
+    float        tileExtent; // Size of a tile of the current level in the function's coordinate space
+    i32          viewX;      // Tile coordinates of the top-left tile in view
+    i32          viewY;
+    i32          viewCols;
+    i32          viewRows;
+    Field_Tile **view;       // Best available tile for each position in the view or NULL if none is available yet
+    u32          viewCap;
+    u32          viewFallbacks;
+    u32          viewMissing;
+} Field_Tile_Cache;
+
+typedef struct Field_Flow_Map Field_Flow_Map;
+
+// Samples of a static function together with how far a particle moves within one frame from each of them
+// The motion is integrated with several RK4 steps when the map is built, so particles only need a single lookup per frame
+// @Note: Only covers a single frame, since every particle draws a line per frame. It makes each step more accurate, but doesn't let particles skip frames
+// Maps are built in the background and kept until the function, zoom or screen size changes
+typedef struct {
+    Field_Flow_Map *map;     // Map of the current function or NULL
+    Field_Flow_Map *retired; // Maps of previous functions, which are freed once no background task uses them anymore
+    u32   bands;             // Amount of bands of map
+    u32   queued;            // Amount of bands of map, that were handed to the background workers
+} Field_Flow_Cache;
+
+Vector2 screenToFunc(float x, float y, float zoom, i32 width, i32 height);
+Vector2 clampFieldValue(Vector2 v);
+bool fieldGridUpdate(Field_Grid *grid, IR func, u32 version, float zoom, i32 width, i32 height, double budget);
+void fieldGridUpdateTime(Field_Grid *grid, float t);
+bool fieldGridSample(const Field_Grid *grid, float x, float y, Vector2 *out);
+void fieldGridFree(Field_Grid *grid);
+bool fieldTreeUpdate(Field_Quadtree *tree, IR func, u32 version, float zoom, i32 width, i32 height, double budget);
+bool fieldTreeSample(const Field_Quadtree *tree, float x, float y, Vector2 *out);
+void fieldTreeFree(Field_Quadtree *tree);
+void fieldTilesUpdate(Field_Tile_Cache *cache, IR func, u64 funcHash, float zoom, i32 width, i32 height);
+bool fieldTilesSample(const Field_Tile_Cache *cache, float x, float y, Vector2 *out);
+void fieldTilesFree(Field_Tile_Cache *cache);
+void fieldFlowUpdate(Field_Flow_Cache *cache, IR func, u32 version, float zoom, i32 width, i32 height);
+bool fieldFlowReady(const Field_Flow_Cache *cache);
+bool fieldFlowSample(const Field_Flow_Cache *cache, float x, float y, Vector2 *out, Vector2 *move);
+void fieldFlowFree(Field_Flow_Cache *cache);
+
+#endif // _FIELD_H_
@@ -1,17 +1,34 @@
 #include "helpers.h"
 
+static u32 RNGState = 69; // @Note: Only used by the render thread. Other threads need to pass their own state to xorshiftR
+
+// @Note: xorshift gets stuck on 0, so that seed is replaced
+void xorshiftSeed(u32 *state, u32 seed)
+{
+	*state = seed ? seed : 69;
+}
+
+u32 xorshiftR(u32 *state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state;
+}
+
+float xorshiftfR(u32 *state, float min, float max)
+{
+	return min + (max - min)*((float)(xorshiftR(state) % UINT32_MAX)/(float)UINT32_MAX);
+}
+
 u32 xorshift(void)
 {
-	static u32 RNGState = 69;
-	RNGState ^= RNGState << 13;
-	RNGState ^= RNGState >> 17;
-	RNGState ^= RNGState << 5;
-	return RNGState;
+	return xorshiftR(&RNGState);
 }
 
 float xorshiftf(float min, float max)
 {
-	return min + (max - min)*((float)(xorshift() % UINT32_MAX)/(float)UINT32_MAX);
+	return xorshiftfR(&RNGState, min, max);
 }
 
 Vector2 addVector2(Vector2 a, Vector2 b)
@@ -6,6 +6,9 @@
 #include "raylib.h"
 #include "ail.h"
 
+void xorshiftSeed(u32 *state, u32 seed);
+u32 xorshiftR(u32 *state);
+float xorshiftfR(u32 *state, float min, float max);
 u32 xorshift(void);
 float xorshiftf(float min, float max);
 Vector2 addVector2(Vector2 a, Vector2 b);
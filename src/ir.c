@@ -1,7 +1,9 @@
 #include "ir.h"
 
+_Thread_local const IR_Eval_Res *irChannels;
+
 // @Note: Keep updated with IR_Inst
-const char *instStrs[] = {"IR_INST_ROOT", "IR_META_INST_FIRST_CHILDLESS", "IR_INST_X", "IR_INST_Y", "IR_INST_LITERAL", "IR_META_INST_LAST_CHILDLESS", "IR_META_INST_FIRST_UNARY", "IR_INST_CONV", "IR_INST_ABS", "IR_INST_SQRT", "IR_INST_LOG", "IR_META_INST_FIRST_TRIG", "IR_INST_SIN", "IR_INST_COS", "IR_INST_TAN", "IR_META_INST_LAST_TRIG", "IR_META_INST_LAST_UNARY", "IR_META_INST_FIRST_BINARY", "IR_INST_VEC2", "IR_INST_MAX", "IR_INST_MIN", "IR_META_INST_LAST_BINARY", "IR_META_INST_FIRST_TERTIARY", "IR_INST_CLAMP", "IR_INST_LERP", "IR_META_INST_LAST_TERTIARY", "IR_META_INST_FIRST_LASSOC", "IR_INST_ADD", "IR_INST_SUB", "IR_INST_MOD", "IR_INST_MUL", "IR_INST_DIV", "IR_META_INST_LAST_LASSOC", "IR_META_INST_FIRST_RASSOC", "IR_INST_POW", "IR_META_INST_LAST_RASSOC", "IR_META_INST_LEN"};
+const char *instStrs[] = {"IR_INST_ROOT", "IR_META_INST_FIRST_CHILDLESS", "IR_INST_X", "IR_INST_Y", "IR_INST_XN", "IR_INST_YN", "IR_INST_T", "IR_INST_LITERAL", "IR_INST_CHANNEL", "IR_META_INST_LAST_CHILDLESS", "IR_META_INST_FIRST_UNARY", "IR_INST_CONV", "IR_INST_ABS", "IR_INST_SQRT", "IR_INST_LOG", "IR_META_INST_FIRST_TRIG", "IR_INST_SIN", "IR_INST_COS", "IR_INST_TAN", "IR_META_INST_LAST_TRIG", "IR_META_INST_LAST_UNARY", "IR_META_INST_FIRST_BINARY", "IR_INST_VEC2", "IR_INST_MAX", "IR_INST_MIN", "IR_META_INST_LAST_BINARY", "IR_META_INST_FIRST_TERTIARY", "IR_INST_CLAMP", "IR_INST_LERP", "IR_META_INST_LAST_TERTIARY", "IR_META_INST_FIRST_LASSOC", "IR_INST_ADD", "IR_INST_SUB", "IR_INST_MUL", "IR_INST_DIV", "IR_INST_MOD", "IR_META_INST_LAST_LASSOC", "IR_META_INST_FIRST_RASSOC", "IR_INST_POW", "IR_META_INST_LAST_RASSOC", "IR_META_INST_LEN"};
 
 // @Note: Keep updated with IR_Type
 const char *typeStrs[] = {"IR_TYPE_INT", "IR_TYPE_FLOAT", "IR_TYPE_VEC2", "IR_TYPE_ANY", "IR_TYPE_LEN"};
@@ -177,7 +179,7 @@ void insertConv(IR *node, i32 idx)
 
 i32 getExpectedChildAmount(IR_Inst inst)
 {
-	AIL_STATIC_ASSERT(IR_META_INST_LEN == 38);
+	AIL_STATIC_ASSERT(IR_META_INST_LEN == 40);
 	AIL_STATIC_ASSERT(IR_META_INST_LAST_CHILDLESS < IR_META_INST_LAST_TRIG);
 	AIL_STATIC_ASSERT(IR_META_INST_LAST_TRIG < IR_META_INST_LAST_UNARY);
 	AIL_STATIC_ASSERT(IR_META_INST_LAST_UNARY < IR_META_INST_LAST_BINARY);
@@ -196,7 +198,7 @@ i32 getExpectedChildAmount(IR_Inst inst)
 // @AIL_TODO: Provide error messages
 bool checkUserFunc(IR *root)
 {
-	AIL_STATIC_ASSERT(IR_META_INST_LEN == 38);
+	AIL_STATIC_ASSERT(IR_META_INST_LEN == 40);
 
 	IR_Inst inst    = root->inst;
 	i32 expectedLen = getExpectedChildAmount(inst);
@@ -205,6 +207,12 @@ bool checkUserFunc(IR *root)
 	if (expectedLen >= 0 && len != expectedLen) return false;
 	if (expectedLen <  0 && len == 0)           return false;
 	for (i32 inst = 0; inst < len; inst++) if (!checkUserFunc(&((IR *)root->children.data)[inst])) return false;
+
+	if      (inst == IR_INST_X || inst == IR_INST_Y || inst == IR_INST_XN || inst == IR_INST_YN || inst == IR_INST_CHANNEL) root->deps = IR_DEP_XY;
+	else if (inst == IR_INST_T) root->deps = IR_DEP_T;
+	else                        root->deps = 0;
+	for (i32 i = 0; i < len; i++) root->deps |= ((IR *)root->children.data)[i].deps;
+
 	if (inst == IR_INST_ROOT) return ((IR *)root->children.data)[len-1].type == IR_TYPE_VEC2;
 
 	AIL_STATIC_ASSERT(IR_TYPE_LEN == 4);
@@ -261,7 +269,7 @@ bool checkUserFunc(IR *root)
 
 IR_Eval_Res evalUserFunc(IR node, Vector2 in)
 {
-	AIL_STATIC_ASSERT(IR_META_INST_LEN == 38);
+	AIL_STATIC_ASSERT(IR_META_INST_LEN == 40);
 	switch (node.inst) {
 		case IR_INST_ROOT: {
 			IR_Eval_Res res;
@@ -300,9 +308,16 @@ IR_Eval_Res evalUserFunc(IR node, Vector2 in)
 		case IR_INST_YN: {
 			return (IR_Eval_Res){ .val = (IR_Val){.f = fabsf(in.y)}, .succ = true };
 		}
+		case IR_INST_T: {
+			// Time needs to be folded into the function with foldTime or timeFoldUpdate before evaluating it
+			return (IR_Eval_Res){0};
+		}
 		case IR_INST_LITERAL: {
 			return (IR_Eval_Res){ .val = node.val, .succ = true };
 		}
+		case IR_INST_CHANNEL: {
+			return irChannels[node.val.i];
+		}
 		case IR_INST_ABS: {
 			IR_Eval_Res res = evalUserFunc(node.children.data[0], in);
 			if (!res.succ) return res;
@@ -544,6 +559,118 @@ IR_Eval_Res evalUserFunc(IR node, Vector2 in)
 	}
 }
 
+// Returns a copy of node, in which every subtree that only depends on time is replaced by its value at time t
+// This way, the parts of the function that are the same for all particles only need to be evaluated once per frame
+// The copy needs to be freed with freeIR
+IR foldTime(IR node, float t)
+{
+	if (node.inst == IR_INST_T) return (IR){ .inst = IR_INST_LITERAL, .type = IR_TYPE_FLOAT, .val = {.f = t}, .children = ail_da_new_empty(IR) };
+	IR out = node;
+	out.children = ail_da_new_empty(IR);
+	for (u32 i = 0; i < node.children.len; i++) ail_da_push(&out.children, foldTime(node.children.data[i], t));
+	if (node.inst != IR_INST_ROOT && node.deps == IR_DEP_T) {
+		IR_Eval_Res res = evalUserFunc(out, (Vector2){0});
+		if (res.succ) {
+			freeIR(&out);
+			out = (IR){ .inst = IR_INST_LITERAL, .type = node.type, .val = res.val, .children = ail_da_new_empty(IR) };
+		}
+	}
+	return out;
+}
+
+IR copyIR(IR node)
+{
+	IR out = node;
+	out.children = ail_da_new_empty(IR);
+	for (u32 i = 0; i < node.children.len; i++) ail_da_push(&out.children, copyIR(node.children.data[i]));
+	return out;
+}
+
+static bool isTimeSubtree(IR node)
+{
+	return node.inst != IR_INST_ROOT && node.deps == IR_DEP_T;
+}
+
+static u32 countTimeSubtrees(IR node)
+{
+	if (isTimeSubtree(node)) return 1;
+	u32 n = 0;
+	for (u32 i = 0; i < node.children.len; i++) n += countTimeSubtrees(node.children.data[i]);
+	return n;
+}
+
+static u32 countTimes(IR node)
+{
+	u32 n = node.inst == IR_INST_T;
+	for (u32 i = 0; i < node.children.len; i++) n += countTimes(node.children.data[i]);
+	return n;
+}
+
+// Moves the subtrees, that only depend on time, from func into the fold, leaving literals in their place
+static void collectTimeSubtrees(IR *node, IR_Time_Fold *fold)
+{
+	if (isTimeSubtree(*node)) {
+		fold->subtrees[fold->len] = *node;
+		*node = (IR){ .inst = IR_INST_LITERAL, .type = node->type, .deps = IR_DEP_T, .val = {0}, .children = ail_da_new_empty(IR) };
+		fold->literals[fold->len++] = node;
+		return;
+	}
+	for (u32 i = 0; i < node->children.len; i++) collectTimeSubtrees(&node->children.data[i], fold);
+}
+
+static void collectTimes(IR *node, IR_Time_Fold *fold)
+{
+	if (node->inst == IR_INST_T) {
+		node->inst = IR_INST_LITERAL;
+		fold->times[fold->timesLen++] = node;
+	}
+	for (u32 i = 0; i < node->children.len; i++) collectTimes(&node->children.data[i], fold);
+}
+
+// @Note: func must have been checked with checkUserFunc, since the fold relies on the dependencies it sets
+void timeFoldInit(IR_Time_Fold *fold, IR func)
+{
+	*fold = (IR_Time_Fold){0};
+	fold->func = copyIR(func);
+	u32 n      = countTimeSubtrees(func);
+	u32 times  = countTimes(func);
+	fold->subtrees = malloc(n*sizeof(IR));
+	fold->literals = malloc(n*sizeof(IR *));
+	fold->times    = malloc(times*sizeof(IR *));
+	// @Note: The pointers stay valid, since neither func's nor the subtrees' children are resized afterwards
+	collectTimeSubtrees(&fold->func, fold);
+	for (u32 i = 0; i < fold->len; i++) collectTimes(&fold->subtrees[i], fold);
+}
+
+// Evaluates the replaced subtrees at time t and writes their values into func
+void timeFoldUpdate(IR_Time_Fold *fold, float t)
+{
+	for (u32 i = 0; i < fold->timesLen; i++) fold->times[i]->val.f = t;
+	for (u32 i = 0; i < fold->len; i++) {
+		IR_Eval_Res res = evalUserFunc(fold->subtrees[i], (Vector2){0});
+		// @Note: Like with foldTime, evaluating the function fails if one of its subtrees failed, since t can't be evaluated on its own
+		fold->literals[i]->inst = res.succ ? IR_INST_LITERAL : IR_INST_T;
+		fold->literals[i]->val  = res.val;
+	}
+}
+
+void timeFoldFree(IR_Time_Fold *fold)
+{
+	if (!fold->func.children.data) return; // Was never initialized
+	for (u32 i = 0; i < fold->len; i++) freeIR(&fold->subtrees[i]);
+	freeIR(&fold->func);
+	free(fold->subtrees);
+	free(fold->literals);
+	free(fold->times);
+	*fold = (IR_Time_Fold){0};
+}
+
+void freeIR(IR *node)
+{
+	for (u32 i = 0; i < node->children.len; i++) freeIR(&node->children.data[i]);
+	ail_da_free(&node->children);
+}
+
 #define RAND_MAX_DEPTH 6
 #define RAND_MIN_DEPTH 2
 #define RAND_PREFERED_CHANCE 99 // in percentage points
@@ -567,7 +694,8 @@ void addRandChildren(IR *node, i32 depth)
 			    if (getPrefered) idx = RAND_PREFERED_NAMED_TOK_MAP_MIN + (xorshift() % RAND_PREFERED_NAMED_TOK_MAP_LEN);
 				else             idx = xorshift() % AIL_ARRLEN(namedTokMap);
 				child = namedTokMap[idx].ir;
-			} while (AIL_UNLIKELY(child.type != IR_TYPE_ANY && child.type != IR_TYPE_FLOAT));
+			// @Note: t is excluded, so random functions stay static and can use every field cache. Animated functions have to be typed in
+			} while (AIL_UNLIKELY((child.type != IR_TYPE_ANY && child.type != IR_TYPE_FLOAT) || child.inst == IR_INST_T));
 			addRandChildren(&child, depth - 1);
 		}
 		ail_da_push(&node->children, child);
@@ -584,6 +712,38 @@ IR randFunction(void)
 	return root;
 }
 
+// FNV-1a hash over the structure of the tree. Equal functions produce equal hashes, even if they were parsed separately
+static u64 hashBytes(u64 hash, const void *data, size_t size)
+{
+	const u8 *bytes = data;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 0x100000001b3;
+	}
+	return hash;
+}
+
+static u64 hashIRHelper(IR node, u64 hash)
+{
+	hash = hashBytes(hash, &node.inst, sizeof(node.inst));
+	hash = hashBytes(hash, &node.type, sizeof(node.type));
+	hash = hashBytes(hash, &node.children.len, sizeof(node.children.len));
+	if (node.inst == IR_INST_LITERAL) {
+		switch (node.type) {
+			case IR_TYPE_INT:   hash = hashBytes(hash, &node.val.i, sizeof(node.val.i)); break;
+			case IR_TYPE_FLOAT: hash = hashBytes(hash, &node.val.f, sizeof(node.val.f)); break;
+			default:            hash = hashBytes(hash, &node.val.v, sizeof(node.val.v)); break;
+		}
+	}
+	for (u32 i = 0; i < node.children.len; i++) hash = hashIRHelper(node.children.data[i], hash);
+	return hash;
+}
+
+u64 hashIR(IR node)
+{
+	return hashIRHelper(node, 0xcbf29ce484222325);
+}
+
 void irToStrHelper(IR node, AIL_DA(char) *sb)
 {
 	IR_NAMED_TOK_MAP namedTokMap[] = NAMED_TOK_MAP;
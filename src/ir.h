@@ -19,7 +19,9 @@ typedef enum __attribute__((__packed__)) {
 	IR_INST_Y,
 	IR_INST_XN,
 	IR_INST_YN,
+	IR_INST_T,
 	IR_INST_LITERAL,
+	IR_INST_CHANNEL, // Only created by the field grid; reads irChannels[val.i]
 	IR_META_INST_LAST_CHILDLESS,
 	IR_META_INST_FIRST_UNARY,
 	IR_INST_CONV, // For converting types
@@ -74,15 +76,34 @@ typedef struct {
 	IR_Val val;
 } IR_Eval_Res;
 
+// Flags for which inputs a subtree depends on
+#define IR_DEP_XY 1
+#define IR_DEP_T  2
+
 typedef struct IR IR;
 AIL_DA_INIT(IR);
 struct IR {
 	IR_Inst inst;
 	IR_Type type;
+	u8 deps; // Set by checkUserFunc
 	IR_Val val;
 	AIL_DA(IR) children;  // array of sub IR trees
 };
 
+// Precomputed values of subtrees, that IR_INST_CHANNEL nodes read while evaluating a function on the current thread
+extern _Thread_local const IR_Eval_Res *irChannels;
+
+// A copy of a function, in which every subtree that only depends on time is replaced by a literal
+// Unlike foldTime, the copy is kept and only the literals are updated every frame, so nothing is allocated per frame
+typedef struct {
+	IR   func;     // Copy of the function. The replaced subtrees are literals with deps set to IR_DEP_T
+	IR  *subtrees; // Copies of the replaced subtrees, in which t is a literal as well
+	IR **literals; // The literal in func, that stands for each of subtrees
+	IR **times;    // The literals in subtrees, that stand for t
+	u32  len;
+	u32  timesLen;
+} IR_Time_Fold;
+
 typedef struct {
 	char *msg;
 	i32 idx;
@@ -119,6 +140,7 @@ typedef struct {
 	(IR_NAMED_TOK_MAP){.s = "max",   .ir = (IR){.inst = IR_INST_MAX,     .type = IR_TYPE_ANY,   .val = {0},       .children = ail_da_new_empty(IR)}}, \
 	(IR_NAMED_TOK_MAP){.s = "min",   .ir = (IR){.inst = IR_INST_MIN,     .type = IR_TYPE_ANY,   .val = {0},       .children = ail_da_new_empty(IR)}}, \
 	(IR_NAMED_TOK_MAP){.s = "vec2",  .ir = (IR){.inst = IR_INST_VEC2,    .type = IR_TYPE_VEC2,  .val = {0},       .children = ail_da_new_empty(IR)}}, \
+	(IR_NAMED_TOK_MAP){.s = "t",     .ir = (IR){.inst = IR_INST_T,       .type = IR_TYPE_FLOAT, .val = {0},       .children = ail_da_new_empty(IR)}}, \
 }
 // @Cleanup: This is super messy, but I'm too lazy to code smth better rn
 #define RAND_PREFERED_NAMED_TOK_MAP_MIN 2
@@ -145,7 +167,14 @@ void insertConv(IR *node, i32 idx);
 i32 getExpectedChildAmount(IR_Inst inst);
 bool checkUserFunc(IR *root);
 IR_Eval_Res evalUserFunc(IR node, Vector2 in);
+IR foldTime(IR node, float t);
+IR copyIR(IR node);
+void timeFoldInit(IR_Time_Fold *fold, IR func);
+void timeFoldUpdate(IR_Time_Fold *fold, float t);
+void timeFoldFree(IR_Time_Fold *fold);
+void freeIR(IR *node);
 IR randFunction(void);
+u64 hashIR(IR node);
 AIL_DA(char) irToStr(IR node);
 
 #endif // _IR_H_
@@ -0,0 +1,471 @@
+#ifndef _WIN32
+#   define _POSIX_C_SOURCE 200112L // For clock_gettime & sysconf, which -std=c11 hides otherwise
+#endif
+#include "jobs.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#ifdef _WIN32
+#   include <windows.h>
+#else
+#   include <unistd.h>
+#   include <time.h>
+#endif
+
+#define MAX_WORKERS 63
+#define MAX_BACKGROUND_WORKERS 4
+#define BACKGROUND_QUEUE_CAP 1024
+
+typedef struct {
+    Job_Func fn;
+    void    *arg;
+    u32      count;
+    u32      chunk;
+    Job_Schedule schedule; // Fixed per batch, so that all threads agree on how items are claimed
+} Job_Batch;
+
+static pthread_t       workers[MAX_WORKERS];
+static u32             workerCount;
+static pthread_mutex_t mutex    = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  wakeCond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t  doneCond = PTHREAD_COND_INITIALIZER;
+static atomic_ullong   generation; // Incremented for every new batch
+static u32             busy;       // Amount of workers currently working on a batch
+static bool            quit;
+static Job_Batch       current;
+static atomic_uint     nextItem;  // Next item for JOB_SCHEDULE_SHARED
+static atomic_uint     doneItems; // Amount of items of the current batch, that were processed
+static atomic_uint     schedule;   // Job_Schedule for the next batch
+// Remaining items of every thread as (first << 32 | end), so that the owner and thieves can both claim items with a single CAS
+static atomic_ullong   ranges[MAX_WORKERS + 1];
+static atomic_uint     steals;
+static double          threadBusy[MAX_WORKERS + 1]; // Only written by the thread itself while working on a batch
+static double          wallSecs;
+
+// @Note: Parallel-fors of background tasks form a second batch, which workers only help with while they have no batch of the owner to work on
+// Items of the side batch are always shared, so that workers can leave it after any chunk, as soon as the owner starts a new batch
+static Job_Batch       side;
+static atomic_uint     sideNext;
+static atomic_uint     sideDone;
+static u32             sideBusy;  // Amount of workers currently helping with the side batch
+static pthread_mutex_t sideOwner    = PTHREAD_MUTEX_INITIALIZER; // Held by the background task, whose parallel-for is the side batch
+static pthread_cond_t  sideDoneCond = PTHREAD_COND_INITIALIZER;
+
+// @Note: Background tasks run on their own threads, so that they never delay a parallel-for on the render thread
+typedef struct {
+    Job_Task fn;
+    void    *arg;
+} Job_Background_Task;
+
+static pthread_t           bgWorkers[MAX_BACKGROUND_WORKERS];
+static u32                 bgWorkerCount;
+static pthread_cond_t      bgCond = PTHREAD_COND_INITIALIZER;
+static Job_Background_Task bgQueue[BACKGROUND_QUEUE_CAP];
+static u32                 bgHead; // Index of the next task to run
+static u32                 bgLen;
+static u32                 bgRunning;
+static _Thread_local bool  onBackgroundThread; // Whether the current thread runs background tasks
+
+static u32 getCoreCount(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? n : 1;
+#endif
+}
+
+static u64 packRange(u32 first, u32 end)
+{
+    return (u64)first << 32 | end;
+}
+
+// Claims up to chunk items from the front of the thread's own range
+static bool popRange(u32 thread, u32 chunk, u32 *from, u32 *to)
+{
+    u64 r = atomic_load(&ranges[thread]);
+    for (;;) {
+        u32 first = r >> 32;
+        u32 end   = (u32)r;
+        if (first >= end) return false;
+        u32 next = AIL_MIN(first + chunk, end);
+        if (atomic_compare_exchange_weak(&ranges[thread], &r, packRange(next, end))) {
+            *from = first;
+            *to   = next;
+            return true;
+        }
+    }
+}
+
+// Claims half of the remaining items (but at least a chunk) from the back of the victim's range
+static bool stealRange(u32 victim, u32 chunk, u32 *from, u32 *to)
+{
+    u64 r = atomic_load(&ranges[victim]);
+    for (;;) {
+        u32 first = r >> 32;
+        u32 end   = (u32)r;
+        if (first >= end) return false;
+        u32 n = AIL_MIN(AIL_MAX((end - first)/2, chunk), end - first);
+        if (atomic_compare_exchange_weak(&ranges[victim], &r, packRange(first, end - n))) {
+            *from = end - n;
+            *to   = end;
+            return true;
+        }
+    }
+}
+
+static void runRange(Job_Batch batch, u32 from, u32 to, u32 thread)
+{
+    batch.fn(batch.arg, from, to, thread);
+    atomic_fetch_add(&doneItems, to - from);
+}
+
+static void runBatch(Job_Batch batch, u32 thread)
+{
+    if (!batch.count) return; // Batch was already finished before this worker woke up
+    double start = getTimeSecs();
+    u32 from, to;
+    switch (batch.schedule) {
+        case JOB_SCHEDULE_SHARED:
+            for (;;) {
+                from = atomic_fetch_add(&nextItem, batch.chunk);
+                if (from >= batch.count) break;
+                runRange(batch, from, AIL_MIN(from + batch.chunk, batch.count), thread);
+            }
+            break;
+        case JOB_SCHEDULE_STATIC:
+            while (popRange(thread, batch.chunk, &from, &to)) runRange(batch, from, to, thread);
+            break;
+        case JOB_SCHEDULE_STEAL:
+            for (;;) {
+                while (popRange(thread, batch.chunk, &from, &to)) runRange(batch, from, to, thread);
+                // @Note: The stolen items become this thread's own range, so that they can be stolen again in turn
+                bool stolen = false;
+                for (u32 i = 1; !stolen && i <= workerCount; i++) stolen = stealRange((thread + i) % (workerCount + 1), batch.chunk, &from, &to);
+                if (!stolen) break;
+                atomic_fetch_add(&steals, 1);
+                atomic_store(&ranges[thread], packRange(from, to));
+            }
+            break;
+        case JOB_SCHEDULE_LEN:
+            AIL_UNREACHABLE();
+    }
+    threadBusy[thread] += getTimeSecs() - start;
+}
+
+// Works on the side batch until all of its items were claimed or, if seen is set, until the owner started a new batch
+static void runSideBatch(Job_Batch batch, u32 thread, const u64 *seen)
+{
+    for (;;) {
+        if (seen && atomic_load(&generation) != *seen) break;
+        u32 from = atomic_fetch_add(&sideNext, batch.chunk);
+        if (from >= batch.count) break;
+        u32 to = AIL_MIN(from + batch.chunk, batch.count);
+        batch.fn(batch.arg, from, to, thread);
+        atomic_fetch_add(&sideDone, to - from);
+    }
+}
+
+// Needs to be called with mutex locked
+static bool sideWaiting(void)
+{
+    return side.count && atomic_load(&sideNext) < side.count;
+}
+
+static void *workerLoop(void *arg)
+{
+    u32 thread = (u32)(uintptr_t)arg;
+    u64 seen   = 0;
+    pthread_mutex_lock(&mutex);
+    for (;;) {
+        while (!quit && generation == seen && !sideWaiting()) pthread_cond_wait(&wakeCond, &mutex);
+        if (quit) break;
+        if (generation == seen) {
+            Job_Batch batch = side;
+            sideBusy++;
+            pthread_mutex_unlock(&mutex);
+            runSideBatch(batch, thread, &seen);
+            pthread_mutex_lock(&mutex);
+            if (--sideBusy == 0) pthread_cond_broadcast(&sideDoneCond);
+            continue;
+        }
+        seen = generation;
+        Job_Batch batch = current;
+        busy++;
+        pthread_mutex_unlock(&mutex);
+        runBatch(batch, thread);
+        pthread_mutex_lock(&mutex);
+        if (--busy == 0) pthread_cond_signal(&doneCond);
+    }
+    pthread_mutex_unlock(&mutex);
+    return NULL;
+}
+
+static void *backgroundLoop(void *arg)
+{
+    (void)arg;
+    onBackgroundThread = true;
+    pthread_mutex_lock(&mutex);
+    for (;;) {
+        while (!quit && !bgLen) pthread_cond_wait(&bgCond, &mutex);
+        if (quit) break;
+        Job_Background_Task task = bgQueue[bgHead];
+        bgHead = (bgHead + 1) % BACKGROUND_QUEUE_CAP;
+        bgLen--;
+        bgRunning++;
+        pthread_mutex_unlock(&mutex);
+        task.fn(task.arg);
+        pthread_mutex_lock(&mutex);
+        bgRunning--;
+    }
+    pthread_mutex_unlock(&mutex);
+    return NULL;
+}
+
+void jobsInit(u32 n)
+{
+    if (!n) n = getCoreCount() - 1;
+    n = AIL_MIN(n, MAX_WORKERS);
+    for (workerCount = 0; workerCount < n; workerCount++) {
+        if (pthread_create(&workers[workerCount], NULL, workerLoop, (void *)(uintptr_t)(workerCount + 1))) break;
+    }
+    u32 bgN = AIL_CLAMP(n/2, 1, MAX_BACKGROUND_WORKERS);
+    for (bgWorkerCount = 0; bgWorkerCount < bgN; bgWorkerCount++) {
+        if (pthread_create(&bgWorkers[bgWorkerCount], NULL, backgroundLoop, NULL)) break;
+    }
+}
+
+void jobsDeinit(void)
+{
+    pthread_mutex_lock(&mutex);
+    quit = true;
+    pthread_cond_broadcast(&wakeCond);
+    pthread_cond_broadcast(&bgCond);
+    pthread_mutex_unlock(&mutex);
+    for (u32 i = 0; i < workerCount; i++)   pthread_join(workers[i], NULL);
+    for (u32 i = 0; i < bgWorkerCount; i++) pthread_join(bgWorkers[i], NULL);
+    workerCount   = 0;
+    bgWorkerCount = 0;
+}
+
+u32 jobsThreadCount(void)
+{
+    return workerCount + 1;
+}
+
+// Runs a parallel-for of a background task as the side batch, with the help of workers that are idle
+// @Note: The stats are left alone, since they belong to the thread, that owns the parallel-fors
+static void sideParallelFor(Job_Batch batch)
+{
+    if (!workerCount || batch.count <= batch.chunk) {
+        batch.fn(batch.arg, 0, batch.count, 0);
+        return;
+    }
+    pthread_mutex_lock(&sideOwner);
+    pthread_mutex_lock(&mutex);
+    side = batch;
+    atomic_store(&sideNext, 0);
+    atomic_store(&sideDone, 0);
+    pthread_cond_broadcast(&wakeCond);
+    pthread_mutex_unlock(&mutex);
+
+    // Thread index 0 is free within the side batch, since the owner never works on it
+    runSideBatch(batch, 0, NULL);
+
+    pthread_mutex_lock(&mutex);
+    while (sideBusy > 0 || atomic_load(&sideDone) < batch.count) pthread_cond_wait(&sideDoneCond, &mutex);
+    side.count = 0;
+    pthread_mutex_unlock(&mutex);
+    pthread_mutex_unlock(&sideOwner);
+}
+
+// Blocks until all items have been processed. The calling thread works on the items as well
+// @Note: Only one thread may call this at a time. Background tasks are the exception, their parallel-fors share the workers, while the owner doesn't need them
+void jobsParallelFor(Job_Func fn, void *arg, u32 count, u32 chunk)
+{
+    if (!count) return;
+    if (!chunk) chunk = 1;
+    if (onBackgroundThread) {
+        sideParallelFor((Job_Batch){ .fn = fn, .arg = arg, .count = count, .chunk = chunk, .schedule = JOB_SCHEDULE_SHARED });
+        return;
+    }
+    double start = getTimeSecs();
+    if (!workerCount || count <= chunk) {
+        fn(arg, 0, count, 0);
+        threadBusy[0] += getTimeSecs() - start;
+        wallSecs      += getTimeSecs() - start;
+        return;
+    }
+
+    Job_Batch batch = { .fn = fn, .arg = arg, .count = count, .chunk = chunk, .schedule = atomic_load(&schedule) };
+    pthread_mutex_lock(&mutex);
+    current = batch;
+    atomic_store(&nextItem, 0);
+    atomic_store(&doneItems, 0);
+    u32 threads = workerCount + 1;
+    for (u32 i = 0; i < threads; i++) atomic_store(&ranges[i], packRange((u64)count*i/threads, (u64)count*(i + 1)/threads));
+    generation++;
+    pthread_cond_broadcast(&wakeCond);
+    pthread_mutex_unlock(&mutex);
+
+    runBatch(batch, 0);
+
+    pthread_mutex_lock(&mutex);
+    // @Note: With JOB_SCHEDULE_STATIC, the shares of workers that didn't wake up yet are still left
+    while (busy > 0 || atomic_load(&doneItems) < count) pthread_cond_wait(&doneCond, &mutex);
+    // @Note: Workers waking up late must not pick up items of the next batch with this batch's function
+    current.count = 0;
+    pthread_mutex_unlock(&mutex);
+    wallSecs += getTimeSecs() - start;
+}
+
+void jobsSetSchedule(Job_Schedule s)
+{
+    atomic_store(&schedule, s);
+}
+
+Job_Schedule jobsGetSchedule(void)
+{
+    return atomic_load(&schedule);
+}
+
+void jobsTakeStats(Job_Stats *stats)
+{
+    *stats = (Job_Stats){ .wallSecs = wallSecs, .steals = atomic_exchange(&steals, 0), .threads = workerCount + 1 };
+    for (u32 i = 0; i <= workerCount; i++) {
+        stats->busySecs   += threadBusy[i];
+        stats->maxBusySecs = AIL_MAX(stats->maxBusySecs, threadBusy[i]);
+        threadBusy[i] = 0;
+    }
+    wallSecs = 0;
+}
+
+// Queues fn to be run on a background thread. Tasks are started in the order they were queued
+// If no background thread could be started, the task is run immediately instead
+bool jobsBackground(Job_Task fn, void *arg)
+{
+    if (!bgWorkerCount) {
+        onBackgroundThread = true;
+        fn(arg);
+        onBackgroundThread = false;
+        return true;
+    }
+    pthread_mutex_lock(&mutex);
+    bool queued = bgLen < BACKGROUND_QUEUE_CAP;
+    if (queued) {
+        bgQueue[(bgHead + bgLen) % BACKGROUND_QUEUE_CAP] = (Job_Background_Task){ .fn = fn, .arg = arg };
+        bgLen++;
+        pthread_cond_signal(&bgCond);
+    }
+    pthread_mutex_unlock(&mutex);
+    return queued;
+}
+
+// Amount of background tasks that are queued or currently running
+u32 jobsBackgroundPending(void)
+{
+    pthread_mutex_lock(&mutex);
+    u32 n = bgLen + bgRunning;
+    pthread_mutex_unlock(&mutex);
+    return n;
+}
+
+struct Job_Thread {
+    pthread_t handle;
+    Job_Task  fn;
+    void     *arg;
+};
+
+static void *dedicatedLoop(void *arg)
+{
+    Job_Thread *thread = arg;
+    thread->fn(thread->arg);
+    return NULL;
+}
+
+// Runs fn on its own thread, so that it can run for as long as it wants without taking up a background thread
+Job_Thread *jobsStartThread(Job_Task fn, void *arg)
+{
+    Job_Thread *thread = malloc(sizeof(Job_Thread));
+    thread->fn  = fn;
+    thread->arg = arg;
+    if (pthread_create(&thread->handle, NULL, dedicatedLoop, thread)) {
+        free(thread);
+        return NULL;
+    }
+    return thread;
+}
+
+// Blocks until the thread's task returned
+void jobsJoinThread(Job_Thread *thread)
+{
+    pthread_join(thread->handle, NULL);
+    free(thread);
+}
+
+void ringInit(Job_Ring *ring, void **items, u32 cap)
+{
+    ring->items = items;
+    ring->cap   = cap;
+    atomic_store(&ring->head, 0);
+    atomic_store(&ring->tail, 0);
+}
+
+void *ringAcquire(Job_Ring *ring)
+{
+    u64 head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    u64 tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    return head - tail < ring->cap ? ring->items[head % ring->cap] : NULL;
+}
+
+void ringPublish(Job_Ring *ring)
+{
+    u64 head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+u32 ringReady(Job_Ring *ring)
+{
+    u64 head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    u64 tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    return head - tail;
+}
+
+void *ringPeek(Job_Ring *ring)
+{
+    u64 tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    return ringReady(ring) ? ring->items[tail % ring->cap] : NULL;
+}
+
+void ringRelease(Job_Ring *ring)
+{
+    u64 tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+double getTimeSecs(void)
+{
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    if (!freq.QuadPart) QueryPerformanceFrequency(&freq);
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return (double)now.QuadPart/(double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+#endif
+}
+
+void sleepSecs(double secs)
+{
+#ifdef _WIN32
+    Sleep((DWORD)(secs*1000));
+#else
+    struct timespec ts = { .tv_sec = (time_t)secs, .tv_nsec = (long)((secs - (time_t)secs)*1e9) };
+    nanosleep(&ts, NULL);
+#endif
+}
@@ -0,0 +1,61 @@
+#ifndef _JOBS_H_
+#define _JOBS_H_
+
+#define  AIL_ALL_IMPL
+#include "ail.h"
+#include <stdbool.h>
+#include <stdatomic.h>
+
+// Processes the items in [from, to). `thread` is 0 for the calling thread and 1..jobsThreadCount()-1 for workers
+typedef void (*Job_Func)(void *arg, u32 from, u32 to, u32 thread);
+// Task that is run in the background
+typedef void (*Job_Task)(void *arg);
+// How the items of a parallel-for are distributed among the threads
+typedef enum {
+    JOB_SCHEDULE_STEAL,  // Every thread starts on its own share of the items and steals from the others, once it runs out
+    JOB_SCHEDULE_SHARED, // All threads take chunks from a single shared counter
+    JOB_SCHEDULE_STATIC, // Every thread only works on its own share of the items
+    JOB_SCHEDULE_LEN,
+} Job_Schedule;
+
+// Statistics of all parallel-fors since the last call to jobsTakeStats
+typedef struct {
+    double wallSecs;    // Time the calling thread spent in parallel-fors
+    double busySecs;    // Time all threads together spent working on items
+    double maxBusySecs; // Time the busiest thread spent working on items
+    u32    steals;
+    u32    threads;
+} Job_Stats;
+
+// Thread that is dedicated to a single long-running task
+typedef struct Job_Thread Job_Thread;
+
+// Bounded lock-free queue for handing preallocated items from exactly one producer thread to exactly one consumer thread
+typedef struct {
+    void        **items;
+    u32           cap;
+    atomic_ullong head; // Amount of items ever published by the producer
+    atomic_ullong tail; // Amount of items ever released by the consumer
+} Job_Ring;
+
+void jobsInit(u32 workers); // If workers is 0, one worker per additional core is started
+void jobsDeinit(void);
+u32  jobsThreadCount(void); // Amount of workers + the calling thread
+void jobsParallelFor(Job_Func fn, void *arg, u32 count, u32 chunk);
+void jobsSetSchedule(Job_Schedule schedule);
+Job_Schedule jobsGetSchedule(void);
+void jobsTakeStats(Job_Stats *stats);
+bool jobsBackground(Job_Task fn, void *arg); // Returns false if the queue is full. Parallel-fors within the task are helped by idle workers
+u32  jobsBackgroundPending(void);
+Job_Thread *jobsStartThread(Job_Task fn, void *arg); // Returns NULL if the thread couldn't be started
+void jobsJoinThread(Job_Thread *thread);
+void  ringInit(Job_Ring *ring, void **items, u32 cap);
+void *ringAcquire(Job_Ring *ring); // Producer: Returns the next free item or NULL if all items are still in use
+void  ringPublish(Job_Ring *ring); // Producer: Hands the acquired item over to the consumer
+u32   ringReady(Job_Ring *ring);   // Consumer: Amount of published items, that weren't released yet
+void *ringPeek(Job_Ring *ring);    // Consumer: Returns the oldest published item, that wasn't released yet, or NULL
+void  ringRelease(Job_Ring *ring); // Consumer: Hands the oldest published item back to the producer
+double getTimeSecs(void); // Monotonic time in seconds, that works without a window being open
+void sleepSecs(double secs);
+
+#endif // _JOBS_H_
@@ -6,6 +6,13 @@
 #include "ail_gui.h"
 #include "helpers.h"
 #include "ir.h"
+#include "jobs.h"
+#include "field.h"
+#include "particles.h"
+#include "softrast.h"
+#include "palette.h"
+#include "capture.h"
+#include "density.h"
 
 // @Note: Define SCREEN_SAVER to start app in fullscreen and close it immediately with Escape
 // @Note: Define START_FULLSCREEN to start app in fullscreen
@@ -18,13 +25,85 @@
 #define INIT_WIDTH 1200
 #define INIT_HEIGHT 800
 #define FPS 60
-#define N 10000
+#define N 200000 // Maximum amount of particles
+#define MIN_PARTICLES  1000
+#define INIT_PARTICLES 10000
+#define BUDGET_MS (1000.0f/FPS)
+#define BUDGET_PARTICLE_SHARE 0.75f // Share of the frame, that simulating and drawing the particles may take up. The rest is left for input handling and as headroom
+#define BUDGET_SMOOTHING 0.1f       // Weight of the newest measurement in the moving average
+#define RESPAWN_SPREAD FPS          // At most 1/RESPAWN_SPREAD of the active particles may respawn in a single frame
+#define CACHE_BUDGET_MS 4.0f        // Time per frame that may be spent on refining field caches after the function or zoom changed
+#define INIT_TRAIL_LEN 12
+#define TRAIL_DECAY_SECS 0.42f // Time in which lines fade to 1/e of their brightness. Matches fading by 10/255 per frame at 60 FPS
+#define SIM_RING_LEN 3          // Frames in flight between the simulation thread and the render thread: one being drawn, one ready and one being simulated
+#define SIM_STALL_SLEEP_MS 0.5f // Time the simulation thread sleeps, while all frames are in use
+#define DEBUG_TEXT_CAP 1024
+#define RENDER_ENCODE_BUFFERS 4     // Frames that may be waiting for or being encoded at once, while rendering offline
+#define RENDER_STALL_SLEEP_MS 1.0f  // Time the offline renderer sleeps, while all frames are being encoded
+#define RENDER_DEFAULT_FRAMES (10*FPS)
+#define SCREENSHOT_BUFFERS    4     // Screenshots that may be waiting to be written at once. Further ones wait on the GPU, until a buffer is free
+#define EXPORT_SCALE         2       // Resolution of exported images relative to the window
+#define EXPORT_SUPERSAMPLE   2       // Exported images are rendered at EXPORT_SUPERSAMPLE times their resolution per axis and then downsampled
+#define EXPORT_FRAMES        ((u32)(3*TRAIL_DECAY_SECS*FPS)) // Frames the particles of an export are traced back, so their lines build up to the trails seen on screen. Needs to stay below 255
+#define EXPORT_MAX_PARTICLES 4000000
 
+// Closed-loop controller, that adjusts the amount of particles to keep their update & draw time within budget
 typedef struct {
-    float x;
-    float y;
-    u8 lifetime;
-} Particle;
+    float targetMs;   // Time in ms that updating & drawing the particles may take per frame
+    float avgMs;      // Moving average of the time in ms that updating & drawing the particles took, including swapping buffers
+    u32   active;     // Amount of particles currently being simulated
+    u32   respawnCap; // Maximum amount of particles that may respawn per frame
+    u32   respawned;  // Amount of particles that respawned in the last frame
+    u32   deferred;   // Amount of particles whose respawn was deferred in the last frame
+    u32   culled;     // Amount of particles that left the screen in the last frame
+    u32   retired;    // Amount of particles that were retired early in the last frame, because their region was over-full
+    bool  fixed;      // Whether the amount of particles was chosen by the user and must not be adjusted
+} Particle_Budget;
+
+// Everything the simulation needs to know from the UI, handed over once per frame
+typedef struct {
+    IR    root;
+    u32   rootVersion;
+    u64   rootHash;
+    float zoom;
+    i32   width;
+    i32   height;
+    float dt;
+    Field_Cache_Mode cacheMode;
+    bool  showTrails;
+    u32   trailLen;
+    bool  quantize;
+    u32   palette;  // Index into palettes
+    bool  density;  // Whether to tone map a density histogram of the particles instead of drawing lines
+    bool  showDebug;
+    float drawMs;   // Time the render thread spent drawing & swapping the last frame, without simulating it
+    bool  threaded; // Whether the simulation runs in parallel to drawing
+} Sim_Params;
+
+// A simulated frame, that is ready to be drawn
+typedef struct {
+    Sim_Params params; // Parameters to simulate the frame with. Filled in by the render thread, before handing the frame to the simulation
+    Line_Batch lines;
+    bool       clear;  // Whether the screen needs to be cleared instead of fading out the previous frame
+    Color     *density;    // Tone mapped densities of params.width*params.height pixels, if params.density is set
+    u32        densityCap; // Amount of pixels density has room for
+    char       debugText[DEBUG_TEXT_CAP];
+} Sim_Frame;
+
+// Snapshot of the particles on screen, which is rendered into an image in the background
+typedef struct {
+    Particles ps;
+    u32       snapshot; // Amount of particles copied from the screen. The remaining ones are spawned into the emptiest regions
+    u32       count;
+    IR        func;     // The user's function with the time of the snapshot folded in
+    float     zoom;
+    i32       width;    // Size of the screen, on which the particles are simulated
+    i32       height;
+    u32       rng;
+    u32       file;     // Index of the export-XXX.png to write
+    Color     palette[PALETTE_LEN];
+    Field_Grid grid;    // Cache of func, filled by the background task
+} Export_Job;
 
 ////////////////////
 // Global Variables (someone better call the clean code police)
@@ -33,14 +112,78 @@ static Rectangle nonFullscreenWin = {0, 0, INIT_WIDTH, INIT_HEIGHT};
 static i32   fieldWidth   = INIT_WIDTH;
 static i32   fieldHeight  = INIT_HEIGHT;
 static bool  showField    = true;
+static bool  showDebug    = false;
+static bool  showTrails   = false; // Draws stored trails instead of fading the previous frame
+static u32   trailLen     = INIT_TRAIL_LEN;
+static bool  quantize     = false; // Stores particle positions as u16 instead of floats
+static u32   paletteIdx;
+static bool  bufferedLines  = true;  // Draws lines with lineRenderer instead of rlgl's immediate mode
+static bool  showDensity    = false; // Draws the density of the particles instead of their lines
+static Line_Renderer lineRenderer;
+static RenderTexture2D accum;   // Lines of all previous frames, fading out over time. Drawn under the HUD every frame
+static Texture2D densityTex;    // Densities of the last frame, which are copied into accum
+static bool  screenshotRequested;
+static u32   nextScreenshot;    // Index of the next screenshot's file, which is searched for once at startup
+static Png_Pool screenshots = { .cap = SCREENSHOT_BUFFERS };
+static Gpu_Readback screenshotReadback; // Screenshots that are being read back from the GPU. @Note: Requests made while all reads are in flight are merged into one
+static u32   nextExport;        // Index of the next export's file, 0 until it was searched for
+static atomic_bool exporting;   // Whether an export is being rendered in the background
+static Gif_Recorder recorder;
+static Gpu_Readback gifReadback; // Recorded frames, that are being read back from the GPU
+static Frame_Stream windowStream; // Streams the field as YUV4MPEG2, while its file is open
+static Gpu_Readback streamReadback;
+static u32   streams;    // Amount of streams started, used to name their files
+static u32   recordings; // Amount of recordings started, used to name their files
+static float drawMs;        // Time the last frame took on the render thread, without simulating it
+static double inlineSimSecs; // Time spent simulating the last frame on the render thread
 static float hideHUDAfter = 5.0f; // in seconds
 static float hideHUDSecs;
-static float hueOffset;
 static float zoomFactor   = 10.0f;
-static Particle *field;
 static IR root;
 static IR updatedRoot;
+static u32 rootVersion; // Incremented whenever root changes
+static u64 rootHash;
+static Field_Cache_Mode cacheMode = FIELD_CACHE_GRID;
+// @Note: Everything below is owned by the simulation, which runs either on the render thread or on its own thread
+static Sim_Params sim; // Parameters of the frame currently being simulated
+static u32 simRNG = 69; // Random state of the simulation, so it doesn't share xorshift's state with the render thread
+static float hueOffset;
+static Palette palette;
+static Particles field;
+static Particle_Occupancy occupancy;
+static Particle_Trails trails;
+static bool trailsShown;
+static Particle_Sort sorter;
+static u32 framesSinceSort;
+static float sortMs; // Duration of the last sort
+static Particle_Budget budget = {
+    .targetMs   = BUDGET_PARTICLE_SHARE*BUDGET_MS,
+    .avgMs      = 0.0f,
+    .active     = INIT_PARTICLES,
+    .respawnCap = INIT_PARTICLES/RESPAWN_SPREAD,
+};
+static IR frameRoot;          // root with all parts, that only depend on time, evaluated for the current frame
+static IR_Time_Fold frameFold; // Fold of root, if it depends on time. frameRoot is its func then
+static u32 frameFoldVersion;   // rootVersion that frameFold was built for
+static float simTime;       // Seconds since the start of the simulation, bound to `t` in the user's function
+static Job_Stats jobStats;  // Parallel-fors of the particle update in the last frame
+static Field_Grid grid;
+static Field_Quadtree tree;
+static Field_Tile_Cache tiles;
+static Field_Flow_Cache flow;
+static Density_Map density; // Only allocated while the density is shown
+// Handing frames from the simulation thread to the render thread
+static Sim_Frame   simFrames[SIM_RING_LEN];
+static void       *simFramePtrs[SIM_RING_LEN];
+static Job_Ring    simRing;
+static Job_Thread *simThread;    // NULL while the simulation runs on the render thread
+static atomic_bool simQuit;
+static bool        simFrameHeld; // Whether the oldest frame in simRing is still being drawn
+static u32         simLate;      // Amount of render frames, for which no new frame was ready
+static u32         simDropped;   // Amount of frames, that were skipped to catch up with the simulation
+static atomic_uint simStalls;    // Amount of times the simulation had to wait for the render thread
 static AIL_Gui_Input_Box inputBox;
+static AIL_Gui_Style debugStyle;
 static char *defaultFunc = "(vec2 (sin (+ x y)) (cos (* x y)))";
 
 
@@ -74,45 +217,472 @@ void toggleFullscreen(void)
     }
 }
 
-Particle randParticle(void)
+// New particles are placed into the emptiest regions of the screen, which gives an even coverage with fewer particles
+void spawnParticle(u32 idx)
 {
-    return (Particle) {
-        .x = xorshiftf(0, fieldWidth),
-        .y = xorshiftf(0, fieldHeight),
-        .lifetime = xorshift() % (5*FPS),
-    };
+    Vector2 pos = occupancySpawnPos(&occupancy, &simRNG);
+    particleSetPos(&field, idx, pos.x, pos.y);
+    field.lifetimes[idx] = xorshiftR(&simRNG) % (5*FPS);
 }
 
-void drawVectorField(void)
+// Respawns are capped, so that many particles dying at once can't blow the frame budget
+// Particles that left the screen are replaced right away instead, since deferring them would drain exactly the regions, that the field pushes particles out of
+// Returns false if the respawn had to be deferred to a later frame
+bool respawnParticle(u32 idx, bool leftScreen)
+{
+    if (!leftScreen && budget.respawned >= budget.respawnCap) {
+        budget.deferred++;
+        return false;
+    }
+    spawnParticle(idx);
+    trailsReset(&trails, idx);
+    if (!leftScreen) budget.respawned++;
+    return true;
+}
+
+void setRoot(IR newRoot)
 {
-    DrawRectangle(0, 0, fieldWidth, fieldHeight, (Color){0, 0, 0, 10});
+    root = newRoot;
+    rootVersion++;
+    rootHash = hashIR(root);
+}
 
-    for (u32 i = 0; i < N; i++) {
-        if (!field[i].lifetime) field[i] = randParticle();
-        // Normalize field value
-        Vector2 in = {
-            .x = 2*zoomFactor*field[i].x/fieldWidth  - zoomFactor,
-            .y = 2*zoomFactor*field[i].y/fieldHeight - zoomFactor,
-        };
-        IR_Eval_Res res = evalUserFunc(root, in);
-        if (!res.succ) break;
-        Vector2 v = res.val.v;
-        // To prevent very unpleasant visualizations, where the lines span the whole screen height/width
-        v.x = AIL_CLAMP(v.x, -2, 2);
-        v.y = AIL_CLAMP(v.y, -2, 2);
-        float len = lenVector2((Vector2){v.x/2.0f, v.y/2.0f});
-        float h   = hueOffset + AIL_LERP(AIL_CLAMP(len, 0, 1), 0.0f, 60.0f);
-        if (h > 360.0f) h -= 360.0f;
-        float s   = AIL_LERP(AIL_CLAMP(len, 0, 1), 0.5f, 1.0f);
-        float l   = 1.0;
-        DrawLine(field[i].x, field[i].y, field[i].x + v.x, field[i].y + v.y, ColorFromHSV(h, s, l));
-        field[i].x += v.x/2.0f;
-        field[i].y += v.y/2.0f;
-        field[i].lifetime--;
+// Evaluates all parts of the function, that only depend on time, once for the current frame instead of once per particle
+// @Note: The fold is only rebuilt when the function changes, so nothing is allocated per frame
+void updateFrameRoot(void)
+{
+    if (!(sim.root.deps & IR_DEP_T)) {
+        frameRoot = sim.root;
+        return;
+    }
+    if (!frameFold.func.children.data || frameFoldVersion != sim.rootVersion) {
+        timeFoldFree(&frameFold);
+        timeFoldInit(&frameFold, sim.root);
+        frameFoldVersion = sim.rootVersion;
+    }
+    timeFoldUpdate(&frameFold, simTime);
+    frameRoot = frameFold.func;
+}
+
+// Whether the grid is used for the selected field cache. It stands in for the other caches for functions depending on time
+bool useFieldGrid(bool animated)
+{
+    if (sim.cacheMode == FIELD_CACHE_NONE) return false;
+    return animated || sim.cacheMode == FIELD_CACHE_GRID || sim.cacheMode == FIELD_CACHE_FLOW;
+}
+
+// Returns the (clamped) field value at the screen coordinates (x, y)
+// Values are clamped to prevent very unpleasant visualizations, where the lines span the whole screen height/width
+// @Note: Called from several threads at once while stepping the particles
+bool sampleField(void *ctx, float x, float y, Vector2 *v)
+{
+    (void)ctx;
+    // @Note: The quadtree, tiles & displacements can't be reused across frames for functions depending on time, so the grid stands in for them
+    // The grid also stands in for the displacements, while they are built
+    bool animated = sim.root.deps & IR_DEP_T;
+    if (useFieldGrid(animated) && fieldGridSample(&grid, x, y, v)) return true;
+    if (sim.cacheMode == FIELD_CACHE_TREE && !animated && fieldTreeSample(&tree, x, y, v)) return true;
+    if (sim.cacheMode == FIELD_CACHE_TILE && !animated && fieldTilesSample(&tiles, x, y, v)) return true;
+    IR_Eval_Res res = evalUserFunc(frameRoot, screenToFunc(x, y, sim.zoom, sim.width, sim.height));
+    *v = clampFieldValue(res.val.v);
+    return res.succ;
+}
+
+// Like sampleField, but also looks up how far a particle moves within the frame from the displacements
+// @Note: Only used once the displacements are complete
+bool advectField(void *ctx, float x, float y, Vector2 *v, Vector2 *move)
+{
+    (void)ctx;
+    return fieldFlowSample(&flow, x, y, v, move);
+}
+
+void updateParticleBudget(float ms)
+{
+    budget.avgMs = AIL_LERP(BUDGET_SMOOTHING, budget.avgMs, ms);
+    if (budget.fixed) return;
+    float ratio  = budget.targetMs / AIL_MAX(budget.avgMs, 0.001f);
+    // @Note: The dead zone between 80% and 100% of the budget prevents the particle count from oscillating
+    if (ratio < 1.0f || ratio > 1.25f) {
+        float scale = AIL_CLAMP(ratio, 0.8f, 1.05f); // Shrink quickly but grow slowly
+        u32 active  = AIL_CLAMP((u32)(scale*budget.active), MIN_PARTICLES, N);
+        // Newly activated particles contain stale data and need to be respawned
+        for (u32 i = budget.active; i < active; i++) field.lifetimes[i] = 0;
+        budget.active = active;
+    }
+    budget.respawnCap = AIL_MAX(budget.active/RESPAWN_SPREAD, 1);
+}
+
+// Formats the statistics of the simulation, which may only be read by the simulation itself
+void formatSimDebugInfo(char *text, size_t size)
+{
+    const char *cacheModeStrs[] = {"none", "grid", "quadtree", "tiles", "displacements"};
+    AIL_STATIC_ASSERT(FIELD_CACHE_LEN == 5);
+    const char *scheduleStrs[] = {"stealing", "shared", "static"};
+    AIL_STATIC_ASSERT(JOB_SCHEDULE_LEN == 3);
+    // @Note: Imbalance is the busiest thread's time relative to the average, so 1 means all threads were busy equally long
+    float imbalance = jobStats.busySecs > 0 ? jobStats.maxBusySecs*jobStats.threads/jobStats.busySecs : 1.0f;
+    char gridChannels[64] = "";
+    if (grid.animated) snprintf(gridChannels, sizeof(gridChannels), ", %u channels recombined every frame", grid.channels);
+    snprintf(text, size,
+             "Particles: %u / %u (%s positions)\n"
+             "Particle time: %.2f / %.2f ms (sorting %.2f ms every %d frames)\n"
+             "Respawns: %u (cap %u, deferred %u, %u left screen, %u retired)\n"
+             "Jobs: %s schedule, %u threads, imbalance %.2f (%u steals)\n"
+             "Trails: %s (length %u), %s palette\n"
+             "Density: %s (peak %.1f hits, %u histograms)\n"
+             "Field cache: %s%s\n"
+             "Grid: %dx%d samples, stride %d%s%s\n"
+             "Quadtree: %u nodes, %u leaves, depth %u%s\n"
+             "Tiles: %u / %u cached, %u pending, level %d (%u fallbacks, %u missing)\n"
+             "Displacements: %s",
+             budget.active, N, field.quantized ? "16-bit" : "float",
+             budget.avgMs, budget.targetMs, sortMs, PARTICLES_SORT_INTERVAL,
+             budget.respawned, budget.respawnCap, budget.deferred, budget.culled, budget.retired,
+             scheduleStrs[jobsGetSchedule()], jobStats.threads, imbalance, jobStats.steals,
+             sim.showTrails ? "on" : "off", sim.trailLen, palettes[sim.palette].name,
+             sim.density ? "on" : "off", density.peak, density.threads,
+             cacheModeStrs[sim.cacheMode], (sim.root.deps & IR_DEP_T) ? " (animated)" : "",
+             grid.cols, grid.rows, grid.stride, grid.passStride ? " (refining)" : "", gridChannels,
+             tree.len, tree.leaves, tree.depth, tree.building ? " (refining)" : "",
+             tiles.len, tiles.cap, atomic_load(&tiles.pending), tiles.level, tiles.viewFallbacks, tiles.viewMissing,
+             !flow.map ? "none" : fieldFlowReady(&flow) ? "ready" : "building");
+}
+
+void drawDebugInfo(const Sim_Frame *frame)
+{
+    char text[DEBUG_TEXT_CAP + 128];
+    snprintf(text, sizeof(text),
+             "FPS: %d\n"
+             "Lines: %s\n"
+             "Recording: %s (%u frames, %u dropped)\n"
+             "Stream: %s (%u frames, %u dropped)\n"
+             "Simulation: %s (%u late, %u dropped, %u stalls)\n"
+             "%s",
+             GetFPS(),
+             !bufferedLines || !lineRenderer.shader ? "immediate mode" : "vertex buffer",
+             gifRecorderRecording(&recorder) ? "on" : recorder.thread ? "encoding" : "off", recorder.captured, recorder.dropped,
+             windowStream.file ? "on" : "off", windowStream.captured, windowStream.dropped,
+             simThread ? "own thread" : "render thread", simLate, simDropped, atomic_load(&simStalls),
+             frame ? frame->debugText : "");
+    AIL_Gui_Drawable_Text drawable = ail_gui_prepTextForDrawing(text, (Rectangle){0, 0, fieldWidth, fieldHeight}, debugStyle);
+    ail_gui_drawPreparedSized(drawable, ail_gui_getMinBounds(drawable, debugStyle), debugStyle);
+    ail_gui_free_drawable_text(&drawable);
+}
+
+// Simulates one frame with the frame's parameters and records everything that needs to be drawn into it
+// @Note: Runs either on the render thread or on the simulation thread, but never on both at once
+void simulateFrame(Sim_Frame *frame)
+{
+    sim = frame->params;
+    if (sim.showTrails && (!trailsShown || trails.len != sim.trailLen)) {
+        // @Note: Trails are only allocated once they are used, since they take up TRAIL_MAX_LEN positions per particle
+        if (!trails.lens) trailsInit(&trails, N, sim.trailLen);
+        trailsSetLen(&trails, sim.trailLen);
+    }
+    trailsShown = sim.showTrails;
+    // @Note: Quantized positions fall back to floats while the screen is too large for them
+    particlesSetQuantized(&field, sim.quantize && sim.width <= PARTICLES_QUANT_MAX + 1 && sim.height <= PARTICLES_QUANT_MAX + 1);
+
+    // @Note: Caches are refined progressively over several frames, so changing the function doesn't make the app hitch
+    simTime += sim.dt;
+    updateFrameRoot();
+    bool animated = sim.root.deps & IR_DEP_T;
+    if (sim.cacheMode == FIELD_CACHE_TREE && !animated) fieldTreeUpdate(&tree, sim.root, sim.rootVersion, sim.zoom, sim.width, sim.height, CACHE_BUDGET_MS/1000.0f);
+    if (sim.cacheMode == FIELD_CACHE_TILE && !animated) fieldTilesUpdate(&tiles, sim.root, sim.rootHash, sim.zoom, sim.width, sim.height);
+    if (sim.cacheMode == FIELD_CACHE_FLOW && !animated) fieldFlowUpdate(&flow, sim.root, sim.rootVersion, sim.zoom, sim.width, sim.height);
+    bool flowReady = sim.cacheMode == FIELD_CACHE_FLOW && !animated && fieldFlowReady(&flow);
+    if (useFieldGrid(animated) && !flowReady) {
+        fieldGridUpdate(&grid, sim.root, sim.rootVersion, sim.zoom, sim.width, sim.height, CACHE_BUDGET_MS/1000.0f);
+        fieldGridUpdateTime(&grid, simTime);
     }
+
+    paletteUpdate(&palette, &palettes[sim.palette], hueOffset);
+
+    double start = getTimeSecs();
+    jobsTakeStats(&jobStats); // Only the particle update should be measured
+    // @Note: Sorting keeps particles, that are close on screen, close in memory, so their field lookups hit the same cache lines
+    if (++framesSinceSort >= PARTICLES_SORT_INTERVAL) {
+        framesSinceSort = 0;
+        double sortStart = getTimeSecs();
+        particlesSort(&field, budget.active, sim.width, sim.height, &sorter);
+        if (sim.showTrails) trailsPermute(&trails, sorter.order, budget.active);
+        sortMs = 1000.0f*(getTimeSecs() - sortStart);
+    }
+    budget.respawned = 0;
+    budget.deferred  = 0;
+    budget.retired   = 0;
+    occupancyBegin(&occupancy, &field, budget.active, sim.width, sim.height);
+    occupancyCollect(&occupancy, &field, budget.active, budget.respawnCap, xorshiftR(&simRNG));
+    // @Note: Only the collected particles are visited, block by block, so the respawns don't depend on the threads
+    u32 blocks = (budget.active + OCCUPANCY_BLOCK - 1)/OCCUPANCY_BLOCK;
+    for (u32 b = 0; b < blocks; b++) {
+        const u32 *collected = &occupancy.respawns[b*OCCUPANCY_BLOCK];
+        for (u32 k = 0; k < occupancy.respawnLens[b]; k++) {
+            u32 i = collected[k] & OCCUPANCY_RESPAWN_INDEX;
+            if (collected[k] & OCCUPANCY_RESPAWN_RETIRE) {
+                // @Note: Particles are only retired when they can be respawned right away, so the visual density is kept up
+                if (budget.respawned >= budget.respawnCap) continue;
+                budget.retired++;
+                field.lifetimes[i] = 0;
+            }
+            // Expired particles on the outermost pixels count as having left the screen and are replaced uncapped, which is harmless
+            respawnParticle(i, collected[k] & OCCUPANCY_RESPAWN_LEFT);
+        }
+    }
+    Particles_Step step = {
+        .sample    = sampleField,
+        .advect    = flowReady ? advectField : NULL,
+        .palette   = palette.colors,
+        .width     = sim.width,
+        .height    = sim.height,
+        .seed      = xorshiftR(&simRNG),
+        .trails    = sim.showTrails ? &trails : NULL,
+    };
+    Line_Batch *lines = &frame->lines;
+    particlesStep(&field, budget.active, &step, lines);
+    budget.culled = atomic_load(&step.culled);
+    jobsTakeStats(&jobStats);
+    if (sim.density) {
+        if (density.width != sim.width || density.height != sim.height) {
+            densityFree(&density);
+            densityInit(&density, sim.width, sim.height);
+        }
+        u32 pixels = sim.width*sim.height;
+        if (frame->densityCap < pixels) {
+            frame->density    = realloc(frame->density, pixels*sizeof(Color));
+            frame->densityCap = pixels;
+        }
+        // @Note: Trails already contain the previous positions, so the hits of previous frames are cleared instead of faded
+        densitySplat(&density, lines);
+        densityResolve(&density, sim.showTrails ? 0.0f : expf(-sim.dt/TRAIL_DECAY_SECS), frame->density);
+    } else if (density.hists) {
+        densityFree(&density);
+    }
+    // @Note: Drawing is included, so the particles are also limited by the GPU. It overlaps with simulating, when the simulation runs on its own thread
+    float simMs = 1000.0f*(getTimeSecs() - start);
+    updateParticleBudget(sim.threaded ? AIL_MAX(simMs, sim.drawMs) : simMs + sim.drawMs);
     hueOffset += 0.1f;
     if (AIL_UNLIKELY(hueOffset > 360.0f)) hueOffset = 0.0f;
 
+    frame->clear = sim.showTrails;
+    frame->debugText[0] = 0;
+    if (sim.showDebug) formatSimDebugInfo(frame->debugText, sizeof(frame->debugText));
+}
+
+Sim_Params getSimParams(void)
+{
+    return (Sim_Params) {
+        .root        = root,
+        .rootVersion = rootVersion,
+        .rootHash    = rootHash,
+        .zoom        = zoomFactor,
+        .width       = fieldWidth,
+        .height      = fieldHeight,
+        .dt          = GetFrameTime(),
+        .cacheMode   = cacheMode,
+        .showTrails  = showTrails,
+        .trailLen    = trailLen,
+        .quantize    = quantize,
+        .palette     = paletteIdx,
+        .density     = showDensity,
+        .showDebug   = showDebug,
+        .drawMs      = drawMs,
+        .threaded    = simThread != NULL,
+    };
+}
+
+// Simulates frames for as long as the render thread consumes them
+// @Note: Once all frames are in use, the simulation waits for the render thread, which keeps it from running ahead
+void simulationLoop(void *arg)
+{
+    (void)arg;
+    while (!atomic_load(&simQuit)) {
+        Sim_Frame *frame = ringAcquire(&simRing);
+        if (!frame) {
+            atomic_fetch_add(&simStalls, 1);
+            sleepSecs(SIM_STALL_SLEEP_MS/1000.0f);
+            continue;
+        }
+        simulateFrame(frame);
+        ringPublish(&simRing);
+    }
+}
+
+// Hands the oldest frame back to the simulation, together with the parameters for simulating it again
+void releaseSimFrame(void)
+{
+    Sim_Frame *frame = ringPeek(&simRing);
+    frame->params = getSimParams();
+    ringRelease(&simRing);
+}
+
+// Returns the frame to draw or NULL if none was simulated yet
+Sim_Frame *nextSimFrame(void)
+{
+    if (!simThread) {
+        double start = getTimeSecs();
+        simFrames[0].params = getSimParams();
+        simulateFrame(&simFrames[0]);
+        inlineSimSecs = getTimeSecs() - start;
+        return &simFrames[0];
+    }
+    inlineSimSecs = 0;
+    if (ringReady(&simRing) <= simFrameHeld) {
+        // The simulation didn't finish a new frame in time, so the last one is drawn again
+        simLate++;
+        return simFrameHeld ? ringPeek(&simRing) : NULL;
+    }
+    if (simFrameHeld) releaseSimFrame();
+    // Only the newest frame is drawn, so the simulation can't lag behind the input
+    while (ringReady(&simRing) > 1) {
+        releaseSimFrame();
+        simDropped++;
+    }
+    simFrameHeld = true;
+    return ringPeek(&simRing);
+}
+
+void setSimThreaded(bool threaded)
+{
+    if (threaded == (simThread != NULL)) return;
+    if (threaded) {
+        for (u32 i = 0; i < SIM_RING_LEN; i++) {
+            simFrames[i].params = getSimParams();
+            simFramePtrs[i]     = &simFrames[i];
+        }
+        ringInit(&simRing, simFramePtrs, SIM_RING_LEN);
+        simFrameHeld = false;
+        atomic_store(&simQuit, false);
+        simThread = jobsStartThread(simulationLoop, NULL);
+    } else {
+        atomic_store(&simQuit, true);
+        jobsJoinThread(simThread);
+        simThread = NULL;
+    }
+}
+
+// Creates the accumulation buffer or resizes it to the window
+// @Note: The previous contents are stretched to the new size, which matches the field, since coordinates are relative to the window size
+void resizeAccum(i32 width, i32 height)
+{
+    RenderTexture2D resized = LoadRenderTexture(width, height);
+    BeginTextureMode(resized);
+    ClearBackground(BLACK);
+    if (accum.id) {
+        BeginBlendMode(BLEND_CUSTOM);
+        // Render textures are stored upside down
+        DrawTexturePro(accum.texture, (Rectangle){0, 0, accum.texture.width, -accum.texture.height}, (Rectangle){0, 0, width, height}, (Vector2){0}, 0, WHITE);
+        EndBlendMode();
+    }
+    EndTextureMode();
+    if (accum.id) UnloadRenderTexture(accum);
+    accum = resized;
+}
+
+// Hands the recorded frames, that finished reading back from the GPU, to the recorder
+// Unless wait is set, reads the GPU didn't finish yet are left for a later frame
+void publishRecordedFrames(bool wait)
+{
+    i32 width, height;
+    while (readbackPoll(&gifReadback, wait, &width, &height)) {
+        u8 *pixels = gifRecorderAcquire(&recorder, width, height);
+        readbackFinish(&gifReadback, pixels, false);
+        if (pixels) gifRecorderPublish(&recorder);
+    }
+}
+
+// Uploads the frame's densities and copies them over the accumulation buffer, which needs to be the current render target
+// @Note: The densities already fade out over time, so they replace the buffer's contents instead of being blended onto them
+void drawDensity(const Sim_Frame *frame)
+{
+    i32 width  = frame->params.width;
+    i32 height = frame->params.height;
+    if (densityTex.width != width || densityTex.height != height) {
+        if (densityTex.id) UnloadTexture(densityTex);
+        densityTex = LoadTextureFromImage((Image){ frame->density, width, height, 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8 });
+    } else {
+        UpdateTexture(densityTex, frame->density);
+    }
+    BeginBlendMode(BLEND_CUSTOM);
+    DrawTexturePro(densityTex, (Rectangle){0, 0, width, height}, (Rectangle){0, 0, accum.texture.width, accum.texture.height}, (Vector2){0}, 0, WHITE);
+    EndBlendMode();
+}
+
+// Hands the streamed frames, that finished reading back from the GPU, to the stream's writer
+// Frames are dropped instead of waiting for the writer, unless wait is set
+void publishStreamedFrames(bool wait)
+{
+    i32 width, height;
+    while (readbackPoll(&streamReadback, wait, &width, &height)) {
+        u8 *pixels = NULL;
+        if (width == windowStream.width && height == windowStream.height) pixels = frameStreamAcquire(&windowStream, wait);
+        else windowStream.dropped++;
+        readbackFinish(&streamReadback, pixels, true);
+        if (pixels) frameStreamPublish(&windowStream);
+    }
+}
+
+void toggleStreaming(void)
+{
+    if (windowStream.file) {
+        publishStreamedFrames(true);
+        frameStreamClose(&windowStream);
+        printf("Streamed %u frames, %u dropped%s\n", windowStream.written, windowStream.dropped, atomic_load(&windowStream.failed) ? ", writing failed" : "");
+        return;
+    }
+    char path[64];
+    do snprintf(path, sizeof(path), "./stream-%03u.y4m", ++streams);
+    while (FileExists(path));
+    if (frameStreamOpen(&windowStream, path, STREAM_Y4M, fieldWidth, fieldHeight, FPS)) printf("Streaming %s\n", path);
+    else printf("Failed to open %s\n", path);
+}
+
+void toggleRecording(void)
+{
+    if (gifRecorderRecording(&recorder)) {
+        publishRecordedFrames(true);
+        gifRecorderStop(&recorder);
+        return;
+    }
+    char path[64];
+    do snprintf(path, sizeof(path), "./recording-%03u.gif", ++recordings);
+    while (FileExists(path));
+    if (gifRecorderStart(&recorder, path, fieldWidth, fieldHeight)) printf("Recording %s\n", path);
+    else printf("The previous recording is still being saved\n");
+}
+
+void drawVectorField(void)
+{
+    Sim_Frame *frame = nextSimFrame();
+    if (accum.texture.width != fieldWidth || accum.texture.height != fieldHeight) resizeAccum(fieldWidth, fieldHeight);
+    publishRecordedFrames(false);
+    if (windowStream.file) {
+        publishStreamedFrames(false);
+        if (atomic_load(&windowStream.failed)) toggleStreaming();
+    }
+    if (frame) {
+        BeginTextureMode(accum);
+        if (frame->params.density) {
+            drawDensity(frame);
+        } else {
+            // @Note: The decay depends on the time between displayed frames, so trails are equally long at any frame rate
+            if (frame->clear) ClearBackground(BLACK);
+            else DrawRectangle(0, 0, fieldWidth, fieldHeight, (Color){0, 0, 0, roundf(255*(1 - expf(-GetFrameTime()/TRAIL_DECAY_SECS)))});
+            if (bufferedLines) lineRendererDraw(&lineRenderer, &frame->lines);
+            else                lineBatchDraw(&frame->lines);
+        }
+        EndTextureMode();
+        // @Note: Only the field is recorded, without the HUD. The frame is copied into the recorder's buffer once its read finished, usually on the next frame
+        if (gifRecorderDue(&recorder, GetFrameTime()) && !readbackStart(&gifReadback, accum.id, accum.texture.width, accum.texture.height)) recorder.dropped++;
+        // Streams reuse the same readback, but keep their own frame rate
+        if (windowStream.file && frameStreamDue(&windowStream, GetFrameTime()) && !readbackStart(&streamReadback, accum.id, accum.texture.width, accum.texture.height)) windowStream.dropped++;
+    }
+    gifRecorderUpdate(&recorder);
+    // @Note: The blending above also fades the alpha channel, so the buffer is copied over the screen instead of being blended onto it
+    BeginBlendMode(BLEND_CUSTOM);
+    DrawTextureRec(accum.texture, (Rectangle){0, 0, accum.texture.width, -accum.texture.height}, (Vector2){0}, WHITE);
+    EndBlendMode();
+
     float wheelVelocity = GetMouseWheelMove();
     if (wheelVelocity == 0.0f) wheelVelocity = lenVector2(GetGesturePinchVector());
     if (wheelVelocity) {
@@ -121,8 +691,9 @@ void drawVectorField(void)
     }
 
     if (IsKeyPressed(KEY_TAB)) {
-        root = randFunction();
-        checkUserFunc(&root);
+        IR newRoot = randFunction();
+        checkUserFunc(&newRoot);
+        setRoot(newRoot);
         ail_da_free(&inputBox.label.text);
         inputBox.label.text = irToStr(root);
         inputBox.cur = 0;
@@ -157,7 +728,7 @@ void drawVectorField(void)
             if (err.msg) {
                 printf("Error in parsing at index %d: '%s'\n", err.idx, err.msg);
             } else if (checkUserFunc(&updatedRoot)) {
-                root = updatedRoot;
+                setRoot(updatedRoot);
             } else {
                 printf("Error in type checking\n");
             }
@@ -165,17 +736,332 @@ void drawVectorField(void)
     } else {
         inputBox.selected = false;
     }
+
+    if (showDebug) drawDebugInfo(frame);
+}
+
+// Simulates and rasterizes frames on the CPU without opening a window and writes them to numbered PNG files
+// Outputs ending in .y4m or .rgba are instead streamed as uncompressed video into a single file or named pipe, or into stdout if the output is "-", "-.y4m" or "-.rgba"
+// The mode "density" tone maps a density histogram of the particles instead of drawing their lines
+// @Note: Frames are encoded on the background threads, so the simulation only waits when all RENDER_ENCODE_BUFFERS frames are still being encoded
+// @Note: Messages go to stderr, so they don't end up in a stream written to stdout
+int renderOffline(int argc, char **argv)
+{
+    if (argc < 1) {
+        fprintf(stderr, "Usage: VectorFields render <function> [width] [height] [particles] [frames] [seed] [zoom] [output prefix | output.y4m | output.rgba | -] [lines | density]\n");
+        return 1;
+    }
+    const char *func   = argv[0];
+    i32         width  = argc > 1 ? atoi(argv[1]) : 3840;
+    i32         height = argc > 2 ? atoi(argv[2]) : 2160;
+    u32         count  = argc > 3 ? strtoul(argv[3], NULL, 10) : N;
+    u32         frames = argc > 4 ? strtoul(argv[4], NULL, 10) : RENDER_DEFAULT_FRAMES;
+    u32         seed   = argc > 5 ? strtoul(argv[5], NULL, 10) : 69;
+    float       zoom   = argc > 6 ? atof(argv[6]) : zoomFactor;
+    const char *output = argc > 7 ? argv[7] : "./frame-";
+    bool        dense  = argc > 8 && !strcmp(argv[8], "density");
+    bool        rgba   = IsFileExtension(output, ".rgba");
+    bool        stream = rgba || IsFileExtension(output, ".y4m") || !strcmp(output, "-");
+    bool        stdOut = !strcmp(output, "-") || !strcmp(output, "-.y4m") || !strcmp(output, "-.rgba");
+    if (width <= 0 || height <= 0 || !count || !frames || zoom <= 0) {
+        fprintf(stderr, "Resolution, particle count, frame count and zoom need to be positive\n");
+        return 1;
+    }
+    IR funcRoot = {0};
+    Parse_Err err = parseUserFunc((char *)func, strlen(func), &funcRoot);
+    if (err.msg) {
+        fprintf(stderr, "Error in parsing at index %d: '%s'\n", err.idx, err.msg);
+        return 1;
+    }
+    if (!checkUserFunc(&funcRoot)) {
+        fprintf(stderr, "Error in type checking\n");
+        return 1;
+    }
+
+    SetTraceLogLevel(stdOut ? LOG_NONE : LOG_WARNING);
+    Frame_Stream frameStream = {0};
+    if (stream && !frameStreamOpen(&frameStream, stdOut ? "-" : output, rgba ? STREAM_RGBA : STREAM_Y4M, width, height, FPS)) {
+        fprintf(stderr, "Failed to open '%s'\n", output);
+        return 1;
+    }
+    xorshiftSeed(&simRNG, seed);
+    setRoot(funcRoot);
+    particlesInit(&field, count);
+    jobsInit(0);
+    budget.active     = count;
+    budget.respawnCap = AIL_MAX(count/RESPAWN_SPREAD, 1);
+    budget.fixed      = true;
+    occupancyBegin(&occupancy, &field, count, width, height);
+    for (u32 i = 0; i < count; i++) spawnParticle(i);
+    Soft_Raster raster;
+    softrastInit(&raster, width, height);
+    Png_Pool pngs = { .cap = RENDER_ENCODE_BUFFERS };
+    fprintf(stderr, "Rendering %u frames of %dx%d with %u particles on %u threads%s\n", frames, width, height, count, jobsThreadCount(), dense ? " as densities" : "");
+
+    Sim_Frame *frame = &simFrames[0];
+    double simSecs    = 0;
+    double rasterSecs = 0;
+    u32    stalls     = 0; // Amount of frames, that had to wait for an encoder or the stream
+    u32    rendered   = 0; // Amount of frames, that were simulated & rasterized, which is less than frames if writing failed
+    double start      = getTimeSecs();
+    for (u32 f = 0; f < frames; f++) {
+        frame->params = (Sim_Params) {
+            .root        = root,
+            .rootVersion = rootVersion,
+            .rootHash    = rootHash,
+            .zoom        = zoom,
+            .width       = width,
+            .height      = height,
+            .dt          = 1.0f/FPS,
+            .cacheMode   = cacheMode,
+            .density     = dense,
+        };
+        double t = getTimeSecs();
+        simulateFrame(frame);
+        simSecs += getTimeSecs() - t;
+        // @Note: Densities are already resolved while simulating
+        const Color *image = frame->density;
+        if (!dense) {
+            t = getTimeSecs();
+            if (frame->clear) softrastClear(&raster, BLACK);
+            else softrastDecay(&raster, expf(-frame->params.dt/TRAIL_DECAY_SECS));
+            softrastDrawLines(&raster, &frame->lines);
+            rasterSecs += getTimeSecs() - t;
+            image = raster.pixels;
+        }
+        rendered++;
+
+        if (stream) {
+            // @Note: Waits while the reader is slower than the simulation
+            u8 *pixels = frameStreamAcquire(&frameStream, true);
+            if (!pixels) {
+                fprintf(stderr, "\nWriting to '%s' failed\n", output);
+                break;
+            }
+            memcpy(pixels, image, width*height*sizeof(Color));
+            frameStreamPublish(&frameStream);
+            fprintf(stderr, "\rFrame %u / %u", f + 1, frames);
+            continue;
+        }
+        Png_Job *png = NULL;
+        for (bool waited = false; !png; waited = true) {
+            png = pngPoolAcquire(&pngs, width, height);
+            if (png) stalls += waited;
+            else sleepSecs(RENDER_STALL_SLEEP_MS/1000.0f);
+        }
+        memcpy(png->pixels, image, width*height*sizeof(Color));
+        snprintf(png->path, sizeof(png->path), "%s%05u.png", output, f + 1);
+        pngPoolSave(png);
+        fprintf(stderr, "\rFrame %u / %u", f + 1, frames);
+    }
+    bool failed = false;
+    u32  written = rendered;
+    if (stream) {
+        frameStreamClose(&frameStream);
+        stalls  = frameStream.stalls;
+        written = frameStream.written;
+        // @Note: The writer may also fail on the last frames, after the loop already handed all of them over
+        failed  = atomic_load(&frameStream.failed);
+    }
+    pngPoolWait(&pngs);
+    double secs = getTimeSecs() - start;
+    fprintf(stderr, "\n%s in %.2f s: %.2f ms simulating and %.2f ms rasterizing per frame, %u frames waited for %s\n",
+            failed ? "Failed" : "Done", secs, 1000.0*simSecs/AIL_MAX(rendered, 1), 1000.0*rasterSecs/AIL_MAX(rendered, 1), stalls, stream ? "the stream" : "an encoder");
+    if (failed) fprintf(stderr, "Only %u of %u frames were written\n", written, frames);
+
+    pngPoolFree(&pngs);
+    softrastFree(&raster);
+    jobsDeinit();
+    fieldGridFree(&grid);
+    occupancyFree(&occupancy);
+    particleSortFree(&sorter);
+    timeFoldFree(&frameFold);
+    densityFree(&density);
+    particlesFree(&field);
+    lineBatchFree(&frame->lines);
+    free(frame->density);
+    return failed ? 1 : 0;
+}
+
+// Returns the first index, for which no file with the formatted name exists yet
+u32 firstFreeFileIndex(const char *format)
+{
+    u32 i = 1;
+    while (FileExists(TextFormat(format, i))) i++;
+    return i;
+}
+
+// Hands the screenshots, that finished reading back from the GPU, to pooled buffers, which are written to the next screenshot-XXX.png in the background
+// Unless wait is set, screenshots stay on the GPU while all buffers are still being written
+void saveScreenshots(bool wait)
+{
+    i32 width, height;
+    while (readbackPoll(&screenshotReadback, wait, &width, &height)) {
+        Png_Job *job = pngPoolAcquire(&screenshots, width, height);
+        for (; !job && wait; job = pngPoolAcquire(&screenshots, width, height)) sleepSecs(PNG_WAIT_SLEEP_MS/1000.0f);
+        if (!job) return;
+        snprintf(job->path, sizeof(job->path), "./screenshot-%03u.png", nextScreenshot++);
+        printf("%s\n", job->path);
+        readbackFinish(&screenshotReadback, job->pixels, true);
+        pngPoolSave(job);
+    }
+}
+
+// Samples the field of the export job ctx
+bool sampleExport(void *ctx, float x, float y, Vector2 *v)
+{
+    Export_Job *job = ctx;
+    if (fieldGridSample(&job->grid, x, y, v)) return true;
+    IR_Eval_Res res = evalUserFunc(job->func, screenToFunc(x, y, job->zoom, job->width, job->height));
+    *v = clampFieldValue(res.val.v);
+    return res.succ;
+}
+
+// Like sampleExport, but in the opposite direction, so particles move back along their paths
+bool sampleExportBackwards(void *ctx, float x, float y, Vector2 *v)
+{
+    if (!sampleExport(ctx, x, y, v)) return false;
+    *v = (Vector2){ -v->x, -v->y };
+    return true;
+}
+
+void exportJobFree(Export_Job *job)
+{
+    fieldGridFree(&job->grid);
+    freeIR(&job->func);
+    particlesFree(&job->ps);
+    free(job);
+}
+
+// Renders an export on the CPU at EXPORT_SUPERSAMPLE times its resolution and writes it to its export-XXX.png
+// The particles are traced back for EXPORT_FRAMES frames first and then drawn on their way forward again, so their trails end where they were in the snapshot
+// @Note: Runs as a background task, so the app keeps running while the export is rendered. Its parallel-fors are helped by workers, whenever the simulation leaves them idle
+void exportTask(void *arg)
+{
+    Export_Job *job   = arg;
+    Particles  *ps    = &job->ps;
+    double      start = getTimeSecs();
+    // @Note: The grid only ever holds job->func, so its version never changes
+    while (!fieldGridUpdate(&job->grid, job->func, 0, job->zoom, job->width, job->height, 1.0));
+
+    // Additional particles fill up the emptiest cells, like the particles respawning on screen
+    Particle_Occupancy occ = {0};
+    occupancyBegin(&occ, ps, job->count, job->width, job->height);
+    for (u32 i = job->snapshot; i < job->count; i++) {
+        Vector2 pos     = occupancySpawnPos(&occ, &job->rng);
+        ps->xs[i]        = pos.x;
+        ps->ys[i]        = pos.y;
+        ps->lifetimes[i] = UINT8_MAX;
+    }
+    occupancyFree(&occ);
+
+    // Frame, in which every particle enters the screen. Particles that don't leave it while being traced back are there from the start
+    u8 *enters = calloc(job->count, sizeof(u8));
+    Line_Batch lines = {0};
+    Particles_Step step = {
+        .sample  = sampleExportBackwards,
+        .ctx     = job,
+        .palette = job->palette,
+        .width   = job->width,
+        .height  = job->height,
+    };
+    for (u32 f = 1; f <= EXPORT_FRAMES; f++) {
+        particlesStep(ps, job->count, &step, &lines);
+        for (u32 i = 0; i < job->count; i++) if (!ps->lifetimes[i] && !enters[i]) enters[i] = EXPORT_FRAMES - f;
+    }
+
+    u32 scale = EXPORT_SCALE*EXPORT_SUPERSAMPLE;
+    Soft_Raster raster = {0};
+    softrastInit(&raster, scale*job->width, scale*job->height);
+    raster.scale = scale;
+    step.sample  = sampleExport;
+    for (u32 i = 0; i < job->count; i++) ps->lifetimes[i] = 0;
+    for (u32 f = 0; f < EXPORT_FRAMES; f++) {
+        for (u32 i = 0; i < job->count; i++) if (enters[i] == f) ps->lifetimes[i] = UINT8_MAX;
+        particlesStep(ps, job->count, &step, &lines);
+        softrastDecay(&raster, expf(-1.0f/FPS/TRAIL_DECAY_SECS));
+        softrastDrawLines(&raster, &lines);
+    }
+
+    i32    width  = EXPORT_SCALE*job->width;
+    i32    height = EXPORT_SCALE*job->height;
+    Color *pixels = malloc(width*height*sizeof(Color));
+    softrastDownsample(&raster, EXPORT_SUPERSAMPLE, pixels);
+    char path[64];
+    snprintf(path, sizeof(path), "./export-%03u.png", job->file);
+    Image img = { pixels, width, height, 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8 };
+    if (ExportImage(img, path)) printf("%s (rendered in %.2f s)\n", path, getTimeSecs() - start);
+    else fprintf(stderr, "Failed to write '%s'\n", path);
+
+    free(pixels);
+    free(enters);
+    softrastFree(&raster);
+    lineBatchFree(&lines);
+    exportJobFree(job);
+    atomic_store(&exporting, false);
 }
 
-int main(void)
+// Snapshots the current particles and renders them at a multiple of the window's resolution into the next export-XXX.png in the background
+// Additional particles are spawned into the emptiest regions, so the lines are as dense as on screen, and the image is supersampled for smoother lines
+// @Note: Animated functions are frozen at the time of the snapshot
+void exportSupersampled(void)
 {
-    field = malloc(N * sizeof(Particle));
+    if (atomic_load(&exporting)) {
+        printf("The previous export is still being rendered\n");
+        return;
+    }
+    bool threaded = simThread != NULL;
+    setSimThreaded(false); // @Note: The simulation only pauses while the particles are copied
+    if (!sim.width || !sim.height) {
+        if (threaded) setSimThreaded(true);
+        return;
+    }
+    Export_Job *job = calloc(1, sizeof(Export_Job));
+    job->count  = AIL_MIN(budget.active*EXPORT_SCALE*EXPORT_SCALE, EXPORT_MAX_PARTICLES);
+    job->func   = foldTime(sim.root, simTime);
+    checkUserFunc(&job->func); // Clears the dependency on time, so the whole field is cached in the grid
+    job->zoom   = sim.zoom;
+    job->width  = sim.width;
+    job->height = sim.height;
+    memcpy(job->palette, palette.colors, sizeof(job->palette));
+    xorshiftSeed(&job->rng, xorshift());
+    particlesInit(&job->ps, job->count);
+    // @Note: Dead particles are left out, since they are respawned before they are drawn again
+    for (u32 i = 0; i < budget.active; i++) {
+        if (!field.lifetimes[i]) continue;
+        Vector2 pos = particleGetPos(&field, i);
+        job->ps.xs[job->snapshot]        = pos.x;
+        job->ps.ys[job->snapshot]        = pos.y;
+        job->ps.lifetimes[job->snapshot] = UINT8_MAX;
+        job->snapshot++;
+    }
+    if (threaded) setSimThreaded(true);
+
+    if (!nextExport) nextExport = firstFreeFileIndex("./export-%03u.png");
+    job->file = nextExport++;
+    printf("Exporting %dx%d with %u particles\n", EXPORT_SCALE*job->width, EXPORT_SCALE*job->height, job->count);
+    atomic_store(&exporting, true);
+    if (!jobsBackground(exportTask, job)) {
+        printf("Too many background tasks to start the export\n");
+        exportJobFree(job);
+        atomic_store(&exporting, false);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1 && !strcmp(argv[1], "render")) return renderOffline(argc - 2, argv + 2);
+    particlesInit(&field, N);
+    jobsInit(0);
 
     SetConfigFlags(FLAG_WINDOW_RESIZABLE);
     InitWindow(fieldWidth, fieldHeight, "Vector Fields");
     SetGesturesEnabled(GESTURE_PINCH_IN | GESTURE_PINCH_OUT);
-    SetTargetFPS(FPS);
+    SetTargetFPS(0); // @Note: Frames are paced in the main loop instead, so the time measured for EndDrawing only includes swapping buffers and waiting for the GPU
     SetExitKey(KEY_F4);
+    lineRendererInit(&lineRenderer, N);
+    rlSetBlendFactors(RL_ONE, RL_ZERO, RL_FUNC_ADD); // BLEND_CUSTOM copies textures instead of blending them
+    nextScreenshot = firstFreeFileIndex("./screenshot-%03u.png");
 #ifdef START_FULLSCREEN
     toggleFullscreen(); // @Note: Starts the application in fullscreen, particularly nice when used as a screen-saver
 #endif
@@ -193,20 +1079,29 @@ int main(void)
         .hAlign       = AIL_GUI_ALIGN_LT,
         .vAlign       = AIL_GUI_ALIGN_LT,
     };
+    debugStyle = ail_gui_cloneStyle(style);
+    debugStyle.color        = RAYWHITE;
+    debugStyle.bg           = BLACK;
+    debugStyle.border_width = 0;
+    debugStyle.font_size    = FONT_SIZE/2;
+    debugStyle.hAlign       = AIL_GUI_ALIGN_RB;
+    debugStyle.vAlign       = AIL_GUI_ALIGN_RB;
     AIL_Gui_Label label = ail_gui_newLabel((Rectangle){0}, defaultFunc, style, style);
     inputBox = ail_gui_newInputBox("", true, true, true, label);
 
-    parseUserFunc(inputBox.label.text.data, inputBox.label.text.len - 1, &root);
-    checkUserFunc(&root);
+    IR initRoot = {0};
+    parseUserFunc(inputBox.label.text.data, inputBox.label.text.len - 1, &initRoot);
+    checkUserFunc(&initRoot);
+    setRoot(initRoot);
+    occupancyBegin(&occupancy, &field, budget.active, fieldWidth, fieldHeight);
+    for (u32 i = 0; i < budget.active; i++) spawnParticle(i);
 
     while (!WindowShouldClose()) {
         if (IsWindowResized()) {
             fieldWidth  = GetScreenWidth();
             fieldHeight = GetScreenHeight();
-            BeginDrawing();
-            ClearBackground(BLACK);
-            EndDrawing();
         }
+        double frameStart = getTimeSecs();
         BeginDrawing();
 
 #ifdef SCREEN_SAVER
@@ -216,27 +1111,21 @@ int main(void)
         if (showField) {
             if (!inputBox.selected) {
                 if (isKeyPressedPopped(KEY_F)) toggleFullscreen();
-                else if (isKeyPressedPopped(KEY_P)) {
-                    const char pathPrefix[] = "./screenshot-";
-                    char path[sizeof(pathPrefix) + 7] = {0};
-                    memcpy(path, pathPrefix, sizeof(pathPrefix));
-                    i32 i = 1;
-                    do {
-                        path[sizeof(pathPrefix) - 1] = i > 100 ? (i-=100) + '0' : '0';
-                        path[sizeof(pathPrefix) + 0] = i > 10  ? (i-=10)  + '0' : '0';
-                        path[sizeof(pathPrefix) + 1] = i + '0';
-                        path[sizeof(pathPrefix) + 2] = '.';
-                        path[sizeof(pathPrefix) + 3] = 'p';
-                        path[sizeof(pathPrefix) + 4] = 'n';
-                        path[sizeof(pathPrefix) + 5] = 'g';
-                        path[sizeof(pathPrefix) + 6] = 0;
-                        i++;
-                    } while (FileExists(path));
-                    printf("%s\n", path);
-                    u8 *pixels = rlReadScreenPixels(fieldWidth, fieldHeight);
-                    Image img  = { pixels, fieldWidth, fieldHeight, 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8 };
-                    ExportImage(img, path);
-                }
+                else if (isKeyPressedPopped(KEY_D)) showDebug = !showDebug;
+                else if (isKeyPressedPopped(KEY_C)) cacheMode = (cacheMode + 1) % FIELD_CACHE_LEN;
+                else if (isKeyPressedPopped(KEY_T)) showTrails = !showTrails;
+                else if (isKeyPressedPopped(KEY_M)) setSimThreaded(!simThread);
+                else if (isKeyPressedPopped(KEY_Q)) quantize = !quantize;
+                else if (isKeyPressedPopped(KEY_L)) bufferedLines = !bufferedLines;
+                else if (isKeyPressedPopped(KEY_G)) showDensity = !showDensity;
+                else if (isKeyPressedPopped(KEY_R)) toggleRecording();
+                else if (isKeyPressedPopped(KEY_V)) toggleStreaming();
+                else if (isKeyPressedPopped(KEY_E)) exportSupersampled();
+                else if (isKeyPressedPopped(KEY_H)) paletteIdx = (paletteIdx + 1) % palettesLen;
+                else if (isKeyPressedPopped(KEY_J)) jobsSetSchedule((jobsGetSchedule() + 1) % JOB_SCHEDULE_LEN);
+                else if (showTrails && isKeyPressedPopped(KEY_LEFT_BRACKET))  trailLen = AIL_MAX(trailLen - 1, TRAIL_MIN_LEN);
+                else if (showTrails && isKeyPressedPopped(KEY_RIGHT_BRACKET)) trailLen = AIL_MIN(trailLen + 1, TRAIL_MAX_LEN);
+                else if (isKeyPressedPopped(KEY_P)) screenshotRequested = true;
                 else if (isKeyPressedPopped(KEY_ESCAPE)) {
                     if (IsWindowState(FLAG_FULLSCREEN_MODE)) toggleFullscreen();
                     else break;
@@ -245,12 +1134,48 @@ int main(void)
                 inputBox.selected = false;
             }
             drawVectorField();
+            // @Note: Taken after drawing, since the back buffer doesn't keep the previous frame
+            saveScreenshots(false);
+            if (screenshotRequested) {
+                rlDrawRenderBatchActive();
+                if (readbackStart(&screenshotReadback, 0, fieldWidth, fieldHeight)) screenshotRequested = false;
+            }
         }
 
         EndDrawing();
+        double frameEnd = getTimeSecs();
+        drawMs = 1000.0f*(frameEnd - frameStart - inlineSimSecs);
+        if (frameEnd - frameStart < 1.0/FPS) sleepSecs(1.0/FPS - (frameEnd - frameStart));
     }
 
+    setSimThreaded(false);
+    publishRecordedFrames(true);
+    gifRecorderFree(&recorder);
+    readbackFree(&gifReadback);
+    if (windowStream.file) toggleStreaming();
+    readbackFree(&streamReadback);
+    saveScreenshots(true);
+    readbackFree(&screenshotReadback);
+    pngPoolFree(&screenshots); // @Note: Needs to happen before jobsDeinit, since the screenshots are written by the background threads
+    while (atomic_load(&exporting)) sleepSecs(RENDER_STALL_SLEEP_MS/1000.0f); // Same for the export
+    lineRendererFree(&lineRenderer);
+    if (accum.id) UnloadRenderTexture(accum);
+    if (densityTex.id) UnloadTexture(densityTex);
     CloseWindow();
-    free(field);
+    fieldTilesFree(&tiles); // @Note: Needs to happen before jobsDeinit, since it waits for the background tasks
+    fieldFlowFree(&flow);
+    jobsDeinit();
+    fieldGridFree(&grid);
+    fieldTreeFree(&tree);
+    occupancyFree(&occupancy);
+    trailsFree(&trails);
+    particleSortFree(&sorter);
+    timeFoldFree(&frameFold);
+    densityFree(&density);
+    particlesFree(&field);
+    for (u32 i = 0; i < SIM_RING_LEN; i++) {
+        lineBatchFree(&simFrames[i].lines);
+        free(simFrames[i].density);
+    }
     return 0;
 }
@@ -0,0 +1,91 @@
+#include "palette.h"
+#include <math.h>
+
+// @Note: New palettes can be added here. Stops are listed from the slowest to the fastest parts of the field
+const Palette_Def palettes[] = {
+    { .name = "classic" },
+    { .name = "ocean",   .len = 4, .stops = { {0x1d, 0x3b, 0x8c, 255}, {0x1f, 0x8f, 0xc9, 255}, {0x5d, 0xe0, 0xd8, 255}, {0xf0, 0xff, 0xfb, 255} } },
+    { .name = "magma",   .len = 5, .stops = { {0x51, 0x12, 0x7c, 255}, {0xb7, 0x37, 0x79, 255}, {0xfc, 0x89, 0x61, 255}, {0xfe, 0xc9, 0x8d, 255}, {0xfc, 0xfd, 0xbf, 255} } },
+    { .name = "viridis", .len = 5, .stops = { {0x44, 0x01, 0x54, 255}, {0x3b, 0x52, 0x8b, 255}, {0x21, 0x91, 0x8c, 255}, {0x5e, 0xc9, 0x62, 255}, {0xfd, 0xe7, 0x25, 255} } },
+};
+const u32 palettesLen = AIL_ARRLEN(palettes);
+
+typedef struct {
+    float l;
+    float a;
+    float b;
+} Oklab;
+
+static float srgbToLinear(u8 c)
+{
+    float x = c/255.0f;
+    return x <= 0.04045f ? x/12.92f : powf((x + 0.055f)/1.055f, 2.4f);
+}
+
+static u8 linearToSrgb(float x)
+{
+    x = AIL_CLAMP(x, 0.0f, 1.0f);
+    float c = x <= 0.0031308f ? 12.92f*x : 1.055f*powf(x, 1/2.4f) - 0.055f;
+    return (u8)(255.0f*c + 0.5f);
+}
+
+// See https://bottosson.github.io/posts/oklab/
+static Oklab colorToOklab(Color c)
+{
+    float r = srgbToLinear(c.r), g = srgbToLinear(c.g), b = srgbToLinear(c.b);
+    float l = cbrtf(0.4122214708f*r + 0.5363325363f*g + 0.0514459929f*b);
+    float m = cbrtf(0.2119034982f*r + 0.6806995451f*g + 0.1073969566f*b);
+    float s = cbrtf(0.0883024619f*r + 0.2817188376f*g + 0.6299787005f*b);
+    return (Oklab) {
+        .l = 0.2104542553f*l + 0.7936177850f*m - 0.0040720468f*s,
+        .a = 1.9779984951f*l - 2.4285922050f*m + 0.4505937099f*s,
+        .b = 0.0259040371f*l + 0.7827717662f*m - 0.8086757660f*s,
+    };
+}
+
+// Colors outside of sRGB are clipped per channel
+static Color oklabToColor(Oklab c)
+{
+    float l = c.l + 0.3963377774f*c.a + 0.2158037573f*c.b;
+    float m = c.l - 0.1055613458f*c.a - 0.0638541728f*c.b;
+    float s = c.l - 0.0894841775f*c.a - 1.2914855480f*c.b;
+    l = l*l*l;
+    m = m*m*m;
+    s = s*s*s;
+    return (Color) {
+        linearToSrgb( 4.0767416621f*l - 3.3077085749f*m + 0.2309699292f*s),
+        linearToSrgb(-1.2684380046f*l + 2.6097574011f*m - 0.3413193965f*s),
+        linearToSrgb(-0.0041960863f*l - 0.7034186147f*m + 1.7076147010f*s),
+        255,
+    };
+}
+
+// Rebuilds the colors if the palette changed or, for palettes without stops, if the hue offset moved into another bucket
+bool paletteUpdate(Palette *palette, const Palette_Def *def, float hueOffset)
+{
+    i32 hueBucket = def->len ? 0 : (i32)(hueOffset/PALETTE_HUE_BUCKET);
+    if (palette->def == def && palette->hueBucket == hueBucket) return false;
+    palette->def       = def;
+    palette->hueBucket = hueBucket;
+
+    Oklab stops[PALETTE_MAX_STOPS];
+    for (u32 i = 0; i < def->len; i++) stops[i] = colorToOklab(def->stops[i]);
+    for (u32 i = 0; i < PALETTE_LEN; i++) {
+        float len = sqrtf((float)i/(PALETTE_LEN - 1));
+        if (!def->len) {
+            float h = hueBucket*PALETTE_HUE_BUCKET + AIL_LERP(len, 0.0f, 60.0f);
+            if (h > 360.0f) h -= 360.0f;
+            palette->colors[i] = ColorFromHSV(h, AIL_LERP(len, 0.5f, 1.0f), 1.0f);
+        } else if (def->len == 1) {
+            palette->colors[i] = def->stops[0];
+        } else {
+            float t    = len*(def->len - 1);
+            u32   stop = AIL_MIN((u32)t, def->len - 2);
+            float f    = t - stop;
+            Oklab a    = stops[stop];
+            Oklab b    = stops[stop + 1];
+            palette->colors[i] = oklabToColor((Oklab){ AIL_LERP(f, a.l, b.l), AIL_LERP(f, a.a, b.a), AIL_LERP(f, a.b, b.b) });
+        }
+    }
+    return true;
+}
@@ -0,0 +1,41 @@
+#ifndef _PALETTE_H_
+#define _PALETTE_H_
+
+#define  AIL_ALL_IMPL
+#include "ail.h"
+#include <stdbool.h>
+#include "raylib.h"
+
+#define PALETTE_LEN        1024 // Colors per palette. Small enough to stay in L1 while stepping the particles
+#define PALETTE_HUE_BUCKET 1.0f // Degrees the hue offset needs to move by, before an animated palette is rebuilt
+#define PALETTE_MAX_STOPS  8
+
+// Colors of the particles depending on the magnitude of the field
+// Palettes without stops rotate their hue over time and get more saturated with the magnitude
+// Palettes with stops spread them evenly over magnitudes from 0 to 1 and interpolate between them in OKLab, so the gradient looks perceptually even
+typedef struct {
+    const char *name;
+    u32   len;
+    Color stops[PALETTE_MAX_STOPS];
+} Palette_Def;
+
+// Lookup table of a palette for the current hue offset
+// @Note: The table is indexed by the squared magnitude, so particles don't need to take a square root to find their color
+typedef struct {
+    Color colors[PALETTE_LEN];
+    const Palette_Def *def; // Palette the colors were built for
+    i32   hueBucket;        // Hue offset in PALETTE_HUE_BUCKETs, that the colors were built for
+} Palette;
+
+extern const Palette_Def palettes[];
+extern const u32 palettesLen;
+
+bool paletteUpdate(Palette *palette, const Palette_Def *def, float hueOffset); // Returns whether the colors were rebuilt
+
+// Index into Palette.colors for a field value with the squared magnitude len2. Magnitudes above 1 get the last color
+static inline u32 paletteIndex(float len2)
+{
+    return (u32)(AIL_MIN(len2, 1.0f)*(PALETTE_LEN - 1));
+}
+
+#endif // _PALETTE_H_
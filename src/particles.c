@@ -0,0 +1,790 @@
+#include "particles.h"
+#include "helpers.h"
+#include "jobs.h"
+#include "rlgl.h"
+#include "external/glad.h" // @Note: Loaded by raylib, whose rlgl only draws triangles from vertex arrays
+#include <stdio.h>
+#include <stddef.h>
+
+#define NO_CELL UINT32_MAX
+
+void particlesInit(Particles *ps, u32 cap)
+{
+    ps->xs        = calloc(cap, sizeof(float));
+    ps->ys        = calloc(cap, sizeof(float));
+    ps->lifetimes = calloc(cap, sizeof(u8));
+    ps->cap       = cap;
+}
+
+static u16 quantize(float x)
+{
+    return (u16)AIL_CLAMP(x*(1 << PARTICLES_FRAC_BITS) + 0.5f, 0, UINT16_MAX);
+}
+
+static float dequantize(u16 q)
+{
+    return q*(1.0f/(1 << PARTICLES_FRAC_BITS));
+}
+
+static u32 hashU32(u32 x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+// Converts the positions of all particles into the given representation and frees the previous one
+// @Note: Quantized positions can only hold screen coordinates up to PARTICLES_QUANT_MAX
+void particlesSetQuantized(Particles *ps, bool quantized)
+{
+    if (ps->quantized == quantized) return;
+    if (quantized) {
+        ps->qxs = malloc(ps->cap*sizeof(u16));
+        ps->qys = malloc(ps->cap*sizeof(u16));
+        for (u32 i = 0; i < ps->cap; i++) {
+            ps->qxs[i] = quantize(ps->xs[i]);
+            ps->qys[i] = quantize(ps->ys[i]);
+        }
+        free(ps->xs);
+        free(ps->ys);
+        ps->xs = ps->ys = NULL;
+    } else {
+        ps->xs = malloc(ps->cap*sizeof(float));
+        ps->ys = malloc(ps->cap*sizeof(float));
+        for (u32 i = 0; i < ps->cap; i++) {
+            ps->xs[i] = dequantize(ps->qxs[i]);
+            ps->ys[i] = dequantize(ps->qys[i]);
+        }
+        free(ps->qxs);
+        free(ps->qys);
+        ps->qxs = ps->qys = NULL;
+    }
+    ps->quantized = quantized;
+}
+
+Vector2 particleGetPos(const Particles *ps, u32 idx)
+{
+    if (ps->quantized) return (Vector2){ dequantize(ps->qxs[idx]), dequantize(ps->qys[idx]) };
+    return (Vector2){ ps->xs[idx], ps->ys[idx] };
+}
+
+void particleSetPos(Particles *ps, u32 idx, float x, float y)
+{
+    if (ps->quantized) {
+        ps->qxs[idx] = quantize(x);
+        ps->qys[idx] = quantize(y);
+    } else {
+        ps->xs[idx] = x;
+        ps->ys[idx] = y;
+    }
+}
+
+typedef struct {
+    Particles      *ps;
+    Particles_Step *step;
+    Line_Batch     *out;
+    u32             count;
+} Particles_Step_Job;
+
+// Samples, colors, records the line to draw and advances n particles in a single pass
+static void stepParticles(Particles_Step *step, float *xs, float *ys, u8 *lifetimes, Vector2 *lines, Color *colors, u32 n)
+{
+    u32 culled = 0;
+    u32 failed = 0;
+    for (u32 i = 0; i < n; i++) {
+        colors[i].a = 0;
+        if (!lifetimes[i]) continue;
+        Vector2 v, move;
+        if (step->advect ? !step->advect(step->ctx, xs[i], ys[i], &v, &move) : !step->sample(step->ctx, xs[i], ys[i], &v)) {
+            failed++;
+            continue;
+        }
+        if (!step->advect) move = (Vector2){ v.x/2.0f, v.y/2.0f };
+        // Functions like sqrt or log of negative numbers yield NaN. Such particles are moved off the screen & culled, so they are respawned right away
+        if (!(isfinite(move.x) && isfinite(move.y) && isfinite(v.x) && isfinite(v.y))) {
+            xs[i]        = -1;
+            ys[i]        = -1;
+            lifetimes[i] = 0;
+            culled++;
+            continue;
+        }
+        colors[i]       = step->palette[paletteIndex((v.x*v.x + v.y*v.y)/4.0f)];
+        lines[2*i]      = (Vector2){ xs[i], ys[i] };
+        lines[2*i + 1]  = (Vector2){ xs[i] + v.x, ys[i] + v.y };
+        xs[i]          += move.x;
+        ys[i]          += move.y;
+        lifetimes[i]--;
+        // Particles leaving the screen are respawned in the next frame instead of being simulated invisibly until their lifetime ends
+        if (!(xs[i] >= 0 && ys[i] >= 0 && xs[i] < step->width && ys[i] < step->height)) {
+            lifetimes[i] = 0;
+            culled++;
+        }
+    }
+    atomic_fetch_add(&step->culled, culled);
+    atomic_fetch_add(&step->failed, failed);
+}
+
+// Records the trails of the particles from `from` to `to` from the lines they just drew, and pushes their current positions
+// Every particle has trails->len lines reserved, so the blocks can record their trails independently. Unused lines stay transparent
+static void stepTrails(const Particles_Step_Job *job, u32 from, u32 to)
+{
+    Particle_Trails *trails = job->step->trails;
+    Line_Batch      *out    = job->out;
+    for (u32 idx = from; idx < to; idx++) {
+        Vector2 *points = &out->points[2*(job->count + idx*trails->len)];
+        Color   *colors = &out->colors[job->count + idx*trails->len];
+        u32      len    = 0;
+        // @Note: All trails share one head, so a particle that didn't push its position this frame would later connect to a stale slot
+        if (!out->colors[idx].a) {
+            trailsReset(trails, idx);
+        } else {
+            const float *xs    = &trails->xs[idx*TRAIL_MAX_LEN];
+            const float *ys    = &trails->ys[idx*TRAIL_MAX_LEN];
+            Vector2      pos   = out->points[2*idx];
+            Color        color = out->colors[idx];
+            u32          slot  = trails->head;
+            // The trail goes from the particle's position back to its oldest stored position, fading out with age
+            for (len = 0; len < trails->lens[idx]; len++) {
+                slot = slot ? slot - 1 : trails->len - 1;
+                points[2*len]     = pos;
+                points[2*len + 1] = (Vector2){ xs[slot], ys[slot] };
+                colors[len]       = (Color){ color.r, color.g, color.b, color.a*(trails->len - len)/trails->len };
+                pos = points[2*len + 1];
+            }
+            trailsPush(trails, idx, out->points[2*idx].x, out->points[2*idx].y);
+        }
+        for (; len < trails->len; len++) colors[len].a = 0;
+    }
+}
+
+static void stepParticleBlock(void *arg, u32 from, u32 to, u32 thread)
+{
+    (void)thread;
+    Particles_Step_Job *job = arg;
+    Particles          *ps  = job->ps;
+    stepParticles(job->step, &ps->xs[from], &ps->ys[from], &ps->lifetimes[from], &job->out->points[2*from], &job->out->colors[from], to - from);
+    if (job->step->trails) stepTrails(job, from, to);
+}
+
+// Decodes the quantized positions into floats, steps them and encodes them again
+// Positions are rounded stochastically, so that movements smaller than the quantization step still add up on average instead of being lost
+static void stepQuantizedBlock(void *arg, u32 from, u32 to, u32 thread)
+{
+    (void)thread;
+    Particles_Step_Job *job = arg;
+    Particles          *ps  = job->ps;
+    float xs[PARTICLES_BLOCK];
+    float ys[PARTICLES_BLOCK];
+    for (u32 start = from; start < to; start += PARTICLES_BLOCK) {
+        u32  n   = AIL_MIN(to - start, PARTICLES_BLOCK);
+        u16 *qxs = &ps->qxs[start];
+        u16 *qys = &ps->qys[start];
+        // @Note: Decoding & encoding are kept in separate loops without branches, so that they can be vectorized
+        for (u32 i = 0; i < n; i++) {
+            xs[i] = dequantize(qxs[i]);
+            ys[i] = dequantize(qys[i]);
+        }
+        stepParticles(job->step, xs, ys, &ps->lifetimes[start], &job->out->points[2*start], &job->out->colors[start], n);
+        if (job->step->trails) stepTrails(job, start, start + n);
+        for (u32 i = 0; i < n; i++) {
+            u32   h  = hashU32(job->step->seed ^ (start + i));
+            float dx = (h & 0xffff)*(1.0f/65536);
+            float dy = (h >> 16)*(1.0f/65536);
+            qxs[i] = (u16)AIL_CLAMP(xs[i]*(1 << PARTICLES_FRAC_BITS) + dx, 0, UINT16_MAX);
+            qys[i] = (u16)AIL_CLAMP(ys[i]*(1 << PARTICLES_FRAC_BITS) + dy, 0, UINT16_MAX);
+        }
+    }
+}
+
+// Advances the first count particles. The line of particle i is recorded as line i of out, which is overwritten
+// Dead particles are skipped, so they need to be respawned before
+void particlesStep(Particles *ps, u32 count, Particles_Step *step, Line_Batch *out)
+{
+    atomic_store(&step->culled, 0);
+    atomic_store(&step->failed, 0);
+    u32 lines = step->trails ? count*(1 + step->trails->len) : count;
+    lineBatchReserve(out, lines);
+    out->len = lines;
+    Particles_Step_Job job = { .ps = ps, .step = step, .out = out, .count = count };
+    jobsParallelFor(ps->quantized ? stepQuantizedBlock : stepParticleBlock, &job, count, PARTICLES_BLOCK);
+    if (step->trails) trailsAdvance(step->trails);
+}
+
+typedef struct {
+    Particles     *ps;
+    Particle_Sort *sort;
+    u32            count;
+    float          scaleX; // Converts screen coordinates to the range of the key's axes
+    float          scaleY;
+    u32            shift;  // Position of the current digit in the keys
+} Particles_Sort_Job;
+
+// Interleaves the lower 16 bits of x with zeros
+static u32 spreadBits(u32 x)
+{
+    x &= 0xffff;
+    x = (x | (x << 8)) & 0x00ff00ff;
+    x = (x | (x << 4)) & 0x0f0f0f0f;
+    x = (x | (x << 2)) & 0x33333333;
+    x = (x | (x << 1)) & 0x55555555;
+    return x;
+}
+
+static void computeSortKeys(void *arg, u32 from, u32 to, u32 thread)
+{
+    (void)thread;
+    Particles_Sort_Job *job = arg;
+    u32 max = (1u << PARTICLES_SORT_BITS) - 1;
+    for (u32 i = from; i < to; i++) {
+        // @Note: Dead particles are respawned before they are stepped, so where they end up in the order doesn't matter
+        Vector2 pos = particleGetPos(job->ps, i);
+        u32 x = (u32)AIL_CLAMP(pos.x*job->scaleX, 0, max);
+        u32 y = (u32)AIL_CLAMP(pos.y*job->scaleY, 0, max);
+        job->sort->keys[i]  = spreadBits(x) | (spreadBits(y) << 1);
+        job->sort->order[i] = i;
+    }
+}
+
+// Items are blocks, so that every histogram covers the same particles, no matter which thread processes them
+static void countSortDigits(void *arg, u32 from, u32 to, u32 thread)
+{
+    (void)thread;
+    Particles_Sort_Job *job = arg;
+    for (u32 b = from; b < to; b++) {
+        u32 *counts = &job->sort->counts[b*256];
+        memset(counts, 0, 256*sizeof(u32));
+        u32 end = AIL_MIN((b + 1)*PARTICLES_SORT_BLOCK, job->count);
+        for (u32 i = b*PARTICLES_SORT_BLOCK; i < end; i++) counts[(job->sort->keys[i] >> job->shift) & 0xff]++;
+    }
+}
+
+static void scatterSortDigits(void *arg, u32 from, u32 to, u32 thread)
+{
+    (void)thread;
+    Particles_Sort_Job *job  = arg;
+    Particle_Sort      *sort = job->sort;
+    for (u32 b = from; b < to; b++) {
+        u32 *offsets = &sort->counts[b*256];
+        u32  end     = AIL_MIN((b + 1)*PARTICLES_SORT_BLOCK, job->count);
+        for (u32 i = b*PARTICLES_SORT_BLOCK; i < end; i++) {
+            u32 dst = offsets[(sort->keys[i] >> job->shift) & 0xff]++;
+            sort->tmpKeys[dst]  = sort->keys[i];
+            sort->tmpOrder[dst] = sort->order[i];
+        }
+    }
+}
+
+static void gatherSortedParticles(void *arg, u32 from, u32 to, u32 thread)
+{
+    (void)thread;
+    Particles_Sort_Job *job  = arg;
+    Particle_Sort      *sort = job->sort;
+    Particles          *ps   = job->ps;
+    for (u32 i = from; i < to; i++) {
+        u32 src = sort->order[i];
+        if (ps->quantized) {
+            // @Note: The float buffers are large enough for quantized positions as well. They are copied back afterwards instead of being swapped
+            ((u16 *)sort->tmpXs)[i] = ps->qxs[src];
+            ((u16 *)sort->tmpYs)[i] = ps->qys[src];
+        } else {
+            sort->tmpXs[i] = ps->xs[src];
+            sort->tmpYs[i] = ps->ys[src];
+        }
+        sort->tmpLifetimes[i] = ps->lifetimes[src];
+    }
+}
+
+// Reorders the first count particles by the Z-order of their position with a parallel LSD radix sort
+// Afterwards, sort->order maps every particle to its previous index, which other per-particle data can be reordered with
+// @Note: Particles at and after count keep stale data, since they are respawned before being activated again
+void particlesSort(Particles *ps, u32 count, i32 width, i32 height, Particle_Sort *sort)
+{
+    if (sort->cap < ps->cap) {
+        particleSortFree(sort);
+        u32 blocks         = (ps->cap + PARTICLES_SORT_BLOCK - 1)/PARTICLES_SORT_BLOCK;
+        sort->keys         = malloc(ps->cap*sizeof(u32));
+        sort->order        = malloc(ps->cap*sizeof(u32));
+        sort->tmpKeys      = malloc(ps->cap*sizeof(u32));
+        sort->tmpOrder     = malloc(ps->cap*sizeof(u32));
+        sort->counts       = malloc(blocks*256*sizeof(u32));
+        sort->tmpXs        = malloc(ps->cap*sizeof(float));
+        sort->tmpYs        = malloc(ps->cap*sizeof(float));
+        sort->tmpLifetimes = malloc(ps->cap*sizeof(u8));
+        sort->cap          = ps->cap;
+    }
+    Particles_Sort_Job job = {
+        .ps     = ps,
+        .sort   = sort,
+        .count  = count,
+        .scaleX = (float)(1u << PARTICLES_SORT_BITS)/AIL_MAX(width,  1),
+        .scaleY = (float)(1u << PARTICLES_SORT_BITS)/AIL_MAX(height, 1),
+    };
+    jobsParallelFor(computeSortKeys, &job, count, 4096);
+
+    u32 blocks = (count + PARTICLES_SORT_BLOCK - 1)/PARTICLES_SORT_BLOCK;
+    for (job.shift = 0; job.shift < 2*PARTICLES_SORT_BITS; job.shift += 8) {
+        jobsParallelFor(countSortDigits, &job, blocks, 1);
+        // Output offsets are ordered by digit first and block second, which keeps the sort stable
+        u32 offset = 0;
+        for (u32 d = 0; d < 256; d++) {
+            for (u32 b = 0; b < blocks; b++) {
+                u32 n = sort->counts[b*256 + d];
+                sort->counts[b*256 + d] = offset;
+                offset += n;
+            }
+        }
+        jobsParallelFor(scatterSortDigits, &job, blocks, 1);
+        AIL_SWAP_PORTABLE(u32 *, sort->keys,  sort->tmpKeys);
+        AIL_SWAP_PORTABLE(u32 *, sort->order, sort->tmpOrder);
+    }
+
+    jobsParallelFor(gatherSortedParticles, &job, count, 4096);
+    if (ps->quantized) {
+        memcpy(ps->qxs, sort->tmpXs, count*sizeof(u16));
+        memcpy(ps->qys, sort->tmpYs, count*sizeof(u16));
+    } else {
+        AIL_SWAP_PORTABLE(float *, ps->xs, sort->tmpXs);
+        AIL_SWAP_PORTABLE(float *, ps->ys, sort->tmpYs);
+    }
+    AIL_SWAP_PORTABLE(u8 *, ps->lifetimes, sort->tmpLifetimes);
+}
+
+void particlesFree(Particles *ps)
+{
+    free(ps->xs);
+    free(ps->ys);
+    free(ps->qxs);
+    free(ps->qys);
+    free(ps->lifetimes);
+    *ps = (Particles){0};
+}
+
+void particleSortFree(Particle_Sort *sort)
+{
+    free(sort->keys);
+    free(sort->order);
+    free(sort->tmpKeys);
+    free(sort->tmpOrder);
+    free(sort->counts);
+    free(sort->tmpXs);
+    free(sort->tmpYs);
+    free(sort->tmpLifetimes);
+    *sort = (Particle_Sort){0};
+}
+
+// Makes room for at least cap lines, keeping the recorded lines
+void lineBatchReserve(Line_Batch *batch, u32 cap)
+{
+    if (cap <= batch->cap) return;
+    cap = AIL_MAX(cap, 2*batch->cap);
+    batch->points = realloc(batch->points, 2*cap*sizeof(Vector2));
+    batch->colors = realloc(batch->colors, cap*sizeof(Color));
+    batch->cap    = cap;
+}
+
+void lineBatchDraw(const Line_Batch *batch)
+{
+    // @Note: rlgl flushes the batch by itself, whenever it runs full, so all lines end up in as few draw calls as possible
+    rlBegin(RL_LINES);
+    for (u32 i = 0; i < batch->len; i++) {
+        Color c = batch->colors[i];
+        if (!c.a) continue;
+        rlColor4ub(c.r, c.g, c.b, c.a);
+        rlVertex2f(batch->points[2*i].x,     batch->points[2*i].y);
+        rlVertex2f(batch->points[2*i + 1].x, batch->points[2*i + 1].y);
+    }
+    rlEnd();
+}
+
+void lineBatchFree(Line_Batch *batch)
+{
+    free(batch->points);
+    free(batch->colors);
+    *batch = (Line_Batch){0};
+}
+
+// Vertex of a line in the renderer's buffer
+typedef struct {
+    Vector2 pos;
+    Color   color;
+} Line_Vertex;
+
+#define LINE_VS_BODY \
+    "in vec2 pos;\n" \
+    "in vec4 color;\n" \
+    "uniform mat4 modelview;\n" \
+    "uniform mat4 projection;\n" \
+    "out vec4 fragColor;\n" \
+    "void main() {\n" \
+    "    fragColor = color;\n" \
+    "    gl_Position = projection*modelview*vec4(pos, 0.0, 1.0);\n" \
+    "}\n"
+#define LINE_FS_BODY \
+    "in vec4 fragColor;\n" \
+    "out vec4 finalColor;\n" \
+    "void main() {\n" \
+    "    finalColor = fragColor;\n" \
+    "}\n"
+
+// Replaces the vertex buffer with one that can hold at least cap lines
+static void reserveLineBuffer(Line_Renderer *renderer, u32 cap)
+{
+    if (cap <= renderer->cap) return;
+    cap = AIL_MAX(cap, 2*renderer->cap);
+    rlEnableVertexArray(renderer->vao);
+    if (renderer->vbo) rlUnloadVertexBuffer(renderer->vbo);
+    i32 posLoc   = rlGetLocationAttrib(renderer->shader, "pos");
+    i32 colorLoc = rlGetLocationAttrib(renderer->shader, "color");
+    renderer->vbo = rlLoadVertexBuffer(NULL, 2*cap*sizeof(Line_Vertex), true);
+    rlSetVertexAttribute(posLoc, 2, RL_FLOAT, false, sizeof(Line_Vertex), (void *)offsetof(Line_Vertex, pos));
+    rlEnableVertexAttribute(posLoc);
+    rlSetVertexAttribute(colorLoc, 4, RL_UNSIGNED_BYTE, true, sizeof(Line_Vertex), (void *)offsetof(Line_Vertex, color));
+    rlEnableVertexAttribute(colorLoc);
+    rlDisableVertexArray();
+    renderer->cap = cap;
+}
+
+// Needs to be called after the window was opened. Preallocates room for cap lines
+void lineRendererInit(Line_Renderer *renderer, u32 cap)
+{
+    *renderer = (Line_Renderer){0};
+    const char *header;
+    switch (rlGetVersion()) {
+        case RL_OPENGL_33:
+        case RL_OPENGL_43:
+            header = "#version 330\n";
+            break;
+        case RL_OPENGL_ES_30:
+            header = "#version 300 es\nprecision mediump float;\n";
+            break;
+        default:
+            return; // Mapping buffers needs OpenGL 3.0 / ES 3.0
+    }
+    char vs[512];
+    char fs[256];
+    snprintf(vs, sizeof(vs), "%s%s", header, LINE_VS_BODY);
+    snprintf(fs, sizeof(fs), "%s%s", header, LINE_FS_BODY);
+    u32 shader = rlLoadShaderCode(vs, fs);
+    if (shader == rlGetShaderIdDefault()) return; // Compiling failed, which rlgl already logged
+    renderer->shader        = shader;
+    renderer->modelviewLoc  = rlGetLocationUniform(shader, "modelview");
+    renderer->projectionLoc = rlGetLocationUniform(shader, "projection");
+    renderer->vao           = rlLoadVertexArray();
+    reserveLineBuffer(renderer, cap);
+}
+
+// Writes all visible lines of the batch into the vertex buffer and draws them with a single call
+// Lines that were drawn with rlgl's immediate mode before are flushed first, so the drawing order is kept
+void lineRendererDraw(Line_Renderer *renderer, const Line_Batch *batch)
+{
+    if (!renderer->shader) {
+        lineBatchDraw(batch);
+        return;
+    }
+    if (!batch->len) return;
+    rlDrawRenderBatchActive();
+    reserveLineBuffer(renderer, batch->len);
+    rlEnableVertexArray(renderer->vao);
+    rlEnableVertexBuffer(renderer->vbo);
+    // @Note: Invalidating the buffer lets the driver hand out fresh memory, while the GPU may still read the previous frame's lines
+    Line_Vertex *vertices = glMapBufferRange(GL_ARRAY_BUFFER, 0, 2*batch->len*sizeof(Line_Vertex), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    u32 count = 0;
+    if (vertices) {
+        for (u32 i = 0; i < batch->len; i++) {
+            Color c = batch->colors[i];
+            if (!c.a) continue;
+            vertices[count++] = (Line_Vertex){ batch->points[2*i],     c };
+            vertices[count++] = (Line_Vertex){ batch->points[2*i + 1], c };
+        }
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+    }
+    if (count) {
+        rlEnableShader(renderer->shader);
+        rlSetUniformMatrix(renderer->modelviewLoc,  rlGetMatrixModelview());
+        rlSetUniformMatrix(renderer->projectionLoc, rlGetMatrixProjection());
+        glDrawArrays(GL_LINES, 0, count);
+        rlDisableShader();
+    }
+    rlDisableVertexBuffer();
+    rlDisableVertexArray();
+}
+
+void lineRendererFree(Line_Renderer *renderer)
+{
+    if (renderer->shader) {
+        rlUnloadVertexArray(renderer->vao);
+        rlUnloadVertexBuffer(renderer->vbo);
+        rlUnloadShaderProgram(renderer->shader);
+    }
+    *renderer = (Line_Renderer){0};
+}
+
+typedef struct {
+    Particle_Occupancy *occ;
+    const Particles    *ps;
+} Occupancy_Bin_Job;
+
+static u32 cellAt(const Particle_Occupancy *occ, float x, float y)
+{
+    if (!(x >= 0 && y >= 0 && x < occ->width && y < occ->height)) return NO_CELL; // Negated, so NaN positions have no cell
+    return (i32)y/OCCUPANCY_CELL*occ->cols + (i32)x/OCCUPANCY_CELL;
+}
+
+static void binParticles(void *arg, u32 from, u32 to, u32 thread)
+{
+    Occupancy_Bin_Job  *job    = arg;
+    Particle_Occupancy *occ    = job->occ;
+    u32                *counts = &occ->threadCounts[thread*occ->cols*occ->rows];
+    for (u32 i = from; i < to; i++) {
+        Vector2 pos = particleGetPos(job->ps, i);
+        u32 cell = cellAt(occ, pos.x, pos.y);
+        if (job->ps->lifetimes[i] && cell != NO_CELL) counts[cell]++;
+    }
+}
+
+static void mergeBins(void *arg, u32 from, u32 to, u32 thread)
+{
+    (void)thread;
+    Particle_Occupancy *occ   = arg;
+    u32                 cells = occ->cols*occ->rows;
+    for (u32 i = from; i < to; i++) {
+        u32 sum = 0;
+        for (u32 t = 0; t < occ->threads; t++) {
+            sum += occ->threadCounts[t*cells + i];
+            occ->threadCounts[t*cells + i] = 0;
+        }
+        occ->counts[i] = sum;
+    }
+}
+
+// Bins all living particles into the grid and orders the under-populated cells by their count
+// Needs to be called at the start of every frame, before any particles are spawned or retired
+void occupancyBegin(Particle_Occupancy *occ, const Particles *ps, u32 count, i32 width, i32 height)
+{
+    if (occ->width != width || occ->height != height || occ->threads != jobsThreadCount()) {
+        i32 cols = (width  + OCCUPANCY_CELL - 1)/OCCUPANCY_CELL;
+        i32 rows = (height + OCCUPANCY_CELL - 1)/OCCUPANCY_CELL;
+        free(occ->counts);
+        free(occ->threadCounts);
+        free(occ->spawnCells);
+        free(occ->retireChances);
+        occ->width        = width;
+        occ->height       = height;
+        occ->cols         = cols;
+        occ->rows         = rows;
+        occ->threads      = jobsThreadCount();
+        occ->counts       = calloc(cols*rows, sizeof(u32));
+        occ->threadCounts = calloc(occ->threads*cols*rows, sizeof(u32));
+        occ->spawnCells   = malloc(cols*rows*sizeof(u32));
+        occ->retireChances = malloc(cols*rows*sizeof(u32));
+    }
+    u32 cells = occ->cols*occ->rows;
+    // @Note: Every thread bins into its own histogram, which are summed up afterwards, so no atomics are needed
+    Occupancy_Bin_Job job = { .occ = occ, .ps = ps };
+    jobsParallelFor(binParticles, &job, count, 4096);
+    jobsParallelFor(mergeBins, occ, cells, 256);
+
+    // Counting sort of all cells below target by their count
+    occ->target = (count + cells - 1)/cells;
+    occ->limit  = OCCUPANCY_MAX_FACTOR*occ->target;
+    if (occ->offsetsCap < occ->target + 1) {
+        occ->offsetsCap = occ->target + 1;
+        occ->offsets    = realloc(occ->offsets, occ->offsetsCap*sizeof(u32));
+    }
+    u32 *offsets = occ->offsets;
+    memset(offsets, 0, (occ->target + 1)*sizeof(u32));
+    for (u32 i = 0; i < cells; i++) if (occ->counts[i] < occ->target) offsets[occ->counts[i] + 1]++;
+    for (u32 i = 1; i <= occ->target; i++) offsets[i] += offsets[i - 1];
+    occ->spawnLen = offsets[occ->target];
+    for (u32 i = 0; i < cells; i++) if (occ->counts[i] < occ->target) occ->spawnCells[offsets[occ->counts[i]]++] = i;
+    occ->spawnCursor = 0;
+    occ->level       = occ->spawnLen ? occ->counts[occ->spawnCells[0]] : occ->target;
+}
+
+typedef struct {
+    Particle_Occupancy *occ;
+    const Particles    *ps;
+    u32                 count;
+    u32                 seed;
+} Occupancy_Collect_Job;
+
+// Items are blocks, so that every block collects the same particles into its slots, no matter which thread processes it
+static void collectRespawns(void *arg, u32 from, u32 to, u32 thread)
+{
+    (void)thread;
+    Occupancy_Collect_Job *job = arg;
+    Particle_Occupancy    *occ = job->occ;
+    for (u32 b = from; b < to; b++) {
+        u32 *out = &occ->respawns[b*OCCUPANCY_BLOCK];
+        u32  len = 0;
+        u32  end = AIL_MIN((b + 1)*OCCUPANCY_BLOCK, job->count);
+        for (u32 i = b*OCCUPANCY_BLOCK; i < end; i++) {
+            Vector2 pos = particleGetPos(job->ps, i);
+            if (!job->ps->lifetimes[i]) {
+                // @Note: Culled particles keep the position outside of the screen, that they were culled at. Quantized positions clamp it onto the outermost pixels,
+                // which are therefore counted as well. Negated, so NaN counts as off screen
+                bool leftScreen = !(pos.x > 0 && pos.y > 0 && pos.x <= occ->width - 1 && pos.y <= occ->height - 1);
+                out[len++] = i | (leftScreen ? OCCUPANCY_RESPAWN_LEFT : 0);
+                continue;
+            }
+            u32 cell = cellAt(occ, pos.x, pos.y);
+            if (cell != NO_CELL && hashU32(job->seed ^ i) < occ->retireChances[cell]) out[len++] = i | OCCUPANCY_RESPAWN_RETIRE;
+        }
+        occ->respawnLens[b] = len;
+    }
+}
+
+// Collects the dead particles and picks particles in over-full cells to be retired, in parallel over blocks of OCCUPANCY_BLOCK particles
+// Convergent fields would otherwise pile up thousands of particles, drawing the same few pixels over and over
+// Every cell retires its particles above limit with the same chance, so that about maxRetire particles are picked in total at most
+// Needs to be called after occupancyBegin, before any particles are spawned
+void occupancyCollect(Particle_Occupancy *occ, const Particles *ps, u32 count, u32 maxRetire, u32 seed)
+{
+    u32 cells  = occ->cols*occ->rows;
+    u64 excess = 0;
+    for (u32 i = 0; i < cells; i++) if (occ->counts[i] > occ->limit) excess += occ->counts[i] - occ->limit;
+    double scale = excess > maxRetire ? (double)maxRetire/excess : 1.0;
+    for (u32 i = 0; i < cells; i++) {
+        u32 n = occ->counts[i];
+        occ->retireChances[i] = n > occ->limit ? (u32)(UINT32_MAX*scale*(n - occ->limit)/n) : 0;
+    }
+
+    u32 blocks = (count + OCCUPANCY_BLOCK - 1)/OCCUPANCY_BLOCK;
+    if (occ->respawnsCap < blocks*OCCUPANCY_BLOCK) {
+        occ->respawnsCap = blocks*OCCUPANCY_BLOCK;
+        occ->respawns    = realloc(occ->respawns,    occ->respawnsCap*sizeof(u32));
+        occ->respawnLens = realloc(occ->respawnLens, blocks*sizeof(u32));
+    }
+    Occupancy_Collect_Job job = { .occ = occ, .ps = ps, .count = count, .seed = seed };
+    jobsParallelFor(collectRespawns, &job, blocks, 1);
+}
+
+// Picks the emptiest cell, filling cells up level by level like water
+static u32 pickSpawnCell(Particle_Occupancy *occ)
+{
+    while (occ->level < occ->target) {
+        // @Note: Cells before the cursor were already raised above level, cells after it are still sorted
+        if (occ->spawnCursor >= occ->spawnLen || occ->counts[occ->spawnCells[occ->spawnCursor]] > occ->level) {
+            occ->level++;
+            occ->spawnCursor = 0;
+            continue;
+        }
+        u32 cell = occ->spawnCells[occ->spawnCursor++];
+        if (occ->counts[cell] == occ->level) {
+            occ->counts[cell]++;
+            return cell;
+        }
+    }
+    return NO_CELL;
+}
+
+// Returns a jittered position in the emptiest cell or a uniformly random position if all cells are full
+Vector2 occupancySpawnPos(Particle_Occupancy *occ, u32 *rng)
+{
+    u32 cell = pickSpawnCell(occ);
+    if (cell == NO_CELL) return (Vector2){ xorshiftfR(rng, 0, occ->width), xorshiftfR(rng, 0, occ->height) };
+    float x = (cell % occ->cols)*OCCUPANCY_CELL;
+    float y = (cell / occ->cols)*OCCUPANCY_CELL;
+    return (Vector2) {
+        .x = xorshiftfR(rng, x, AIL_MIN(x + OCCUPANCY_CELL, occ->width)),
+        .y = xorshiftfR(rng, y, AIL_MIN(y + OCCUPANCY_CELL, occ->height)),
+    };
+}
+
+void occupancyFree(Particle_Occupancy *occ)
+{
+    free(occ->counts);
+    free(occ->threadCounts);
+    free(occ->spawnCells);
+    free(occ->offsets);
+    free(occ->retireChances);
+    free(occ->respawns);
+    free(occ->respawnLens);
+    *occ = (Particle_Occupancy){0};
+}
+
+void trailsInit(Particle_Trails *trails, u32 particles, u32 len)
+{
+    trails->xs   = malloc(particles*TRAIL_MAX_LEN*sizeof(float));
+    trails->ys   = malloc(particles*TRAIL_MAX_LEN*sizeof(float));
+    trails->lens = calloc(particles, sizeof(u8));
+    trails->cap  = particles;
+    trails->len  = AIL_CLAMP(len, TRAIL_MIN_LEN, TRAIL_MAX_LEN);
+    trails->head = 0;
+}
+
+// Changing the length invalidates the order of the ring buffers, so all trails start over
+void trailsSetLen(Particle_Trails *trails, u32 len)
+{
+    trails->len  = AIL_CLAMP(len, TRAIL_MIN_LEN, TRAIL_MAX_LEN);
+    trails->head = 0;
+    if (trails->lens) memset(trails->lens, 0, trails->cap*sizeof(u8));
+}
+
+void trailsReset(Particle_Trails *trails, u32 idx)
+{
+    if (trails->lens) trails->lens[idx] = 0;
+}
+
+void trailsPush(Particle_Trails *trails, u32 idx, float x, float y)
+{
+    u32 slot = idx*TRAIL_MAX_LEN + trails->head;
+    trails->xs[slot] = x;
+    trails->ys[slot] = y;
+    if (trails->lens[idx] < trails->len) trails->lens[idx]++;
+}
+
+// Needs to be called once per frame, after all particles pushed their position
+void trailsAdvance(Particle_Trails *trails)
+{
+    trails->head = (trails->head + 1) % trails->len;
+}
+
+typedef struct {
+    Particle_Trails *trails;
+    const u32       *order;
+} Trails_Permute_Job;
+
+static void gatherTrails(void *arg, u32 from, u32 to, u32 thread)
+{
+    (void)thread;
+    Trails_Permute_Job *job    = arg;
+    Particle_Trails    *trails = job->trails;
+    for (u32 i = from; i < to; i++) {
+        u32 src = job->order[i];
+        memcpy(&trails->spareXs[i*TRAIL_MAX_LEN], &trails->xs[src*TRAIL_MAX_LEN], trails->len*sizeof(float));
+        memcpy(&trails->spareYs[i*TRAIL_MAX_LEN], &trails->ys[src*TRAIL_MAX_LEN], trails->len*sizeof(float));
+        trails->spareLens[i] = trails->lens[src];
+    }
+}
+
+// Moves the trails of the first count particles along with the particles, after they were reordered
+void trailsPermute(Particle_Trails *trails, const u32 *order, u32 count)
+{
+    if (!trails->spareXs) {
+        trails->spareXs   = malloc(trails->cap*TRAIL_MAX_LEN*sizeof(float));
+        trails->spareYs   = malloc(trails->cap*TRAIL_MAX_LEN*sizeof(float));
+        trails->spareLens = malloc(trails->cap*sizeof(u8));
+    }
+    Trails_Permute_Job job = { .trails = trails, .order = order };
+    jobsParallelFor(gatherTrails, &job, count, 1024);
+    // Trails after count are reset, since their particles are respawned before being activated again anyway
+    memset(&trails->spareLens[count], 0, trails->cap - count);
+    AIL_SWAP_PORTABLE(float *, trails->xs,   trails->spareXs);
+    AIL_SWAP_PORTABLE(float *, trails->ys,   trails->spareYs);
+    AIL_SWAP_PORTABLE(u8 *,    trails->lens, trails->spareLens);
+}
+
+void trailsFree(Particle_Trails *trails)
+{
+    free(trails->xs);
+    free(trails->ys);
+    free(trails->lens);
+    free(trails->spareXs);
+    free(trails->spareYs);
+    free(trails->spareLens);
+    *trails = (Particle_Trails){0};
+}
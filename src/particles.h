@@ -0,0 +1,152 @@
+#ifndef _PARTICLES_H_
+#define _PARTICLES_H_
+
+#define  AIL_ALL_IMPL
+#include "ail.h"
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "raylib.h"
+#include "palette.h"
+
+#define OCCUPANCY_CELL       32 // Size in pixels of a cell in the occupancy grid
+#define OCCUPANCY_MAX_FACTOR 4  // Cells with more than OCCUPANCY_MAX_FACTOR times their share of particles have particles retired early
+#define OCCUPANCY_BLOCK      4096 // Particles per block while collecting respawns. Every block collects into its own slots, so the collected order doesn't depend on the threads
+#define OCCUPANCY_RESPAWN_RETIRE (1u << 31) // Flag of collected particles, that are alive and should be retired
+#define OCCUPANCY_RESPAWN_LEFT   (1u << 30) // Flag of collected particles, that died off the screen
+#define OCCUPANCY_RESPAWN_INDEX  (OCCUPANCY_RESPAWN_LEFT - 1)
+#define TRAIL_MIN_LEN        2
+#define TRAIL_MAX_LEN        32 // Maximum amount of past positions kept per particle
+
+#define PARTICLES_BLOCK 256 // Amount of particles updated per job, small enough for expensive regions of the field to be spread over several threads
+#define PARTICLES_FRAC_BITS 4 // Sub-pixel bits of quantized positions
+#define PARTICLES_QUANT_MAX ((1 << (16 - PARTICLES_FRAC_BITS)) - 1) // Largest screen coordinate, that quantized positions can hold
+#define PARTICLES_SORT_INTERVAL 32    // Frames between sorting the particles by their position
+#define PARTICLES_SORT_BITS     12    // Bits per axis of the position keys. Needs to be a multiple of 4, so that the keys consist of whole digits
+#define PARTICLES_SORT_BLOCK    16384 // Amount of particles per histogram of the radix sort
+
+// Particles are stored as a structure of arrays, so that every step streams through the data exactly once
+// @Note: Positions are stored either as floats or quantized to u16 fixed-point numbers, which halves the memory traffic with many particles
+typedef struct {
+    float *xs;        // NULL if quantized
+    float *ys;
+    u16   *qxs;       // Positions with PARTICLES_FRAC_BITS sub-pixel bits. NULL if not quantized
+    u16   *qys;
+    u8    *lifetimes; // Frames left until the particle respawns or 0 if it needs to be respawned
+    u32    cap;
+    bool   quantized;
+} Particles;
+
+// Lines recorded while simulating a frame, which are submitted for drawing afterwards, possibly by another thread
+typedef struct {
+    Vector2 *points; // Start & end of every line
+    Color   *colors; // Color of every line. Fully transparent lines are skipped
+    u32      len;
+    u32      cap;
+} Line_Batch;
+
+// Scratch space for sorting particles along a Z-order curve, so that particles close in memory also sample close parts of the field
+typedef struct {
+    u32   *keys;
+    u32   *order;    // Previous index of the particle at every index, valid after sorting
+    u32   *tmpKeys;
+    u32   *tmpOrder;
+    u32   *counts;   // Histogram of the current digit per block, turned into the output offsets of every block
+    float *tmpXs;
+    float *tmpYs;
+    u8    *tmpLifetimes;
+    u32    cap;
+} Particle_Sort;
+
+// Draws line batches with a single GL_LINES draw call from one persistent vertex buffer, instead of going through rlgl's immediate mode
+// Both ends of every visible line are written straight into the mapped buffer with the line's color, so nothing is expanded on the GPU
+typedef struct {
+    u32 shader;        // 0 before OpenGL 3.3 / ES 3.0, in which case lineBatchDraw is used instead
+    i32 modelviewLoc;
+    i32 projectionLoc;
+    u32 vao;
+    u32 vbo;           // Two Line_Vertex per line
+    u32 cap;           // Amount of lines the buffer can hold
+} Line_Renderer;
+
+// Ring buffers of the last positions of every particle, which are drawn as fading polylines
+// @Note: All particles share the same head, since every living particle pushes exactly one position per frame
+typedef struct {
+    float *xs;   // TRAIL_MAX_LEN slots per particle
+    float *ys;
+    u8    *lens; // Amount of valid positions per particle
+    u32    cap;  // Amount of particles that trails are stored for
+    u32    len;  // Amount of positions kept per particle
+    u32    head; // Slot that the next position is written into
+    float *spareXs; // Buffers the trails are reordered into, only allocated once particles are sorted
+    float *spareYs;
+    u8    *spareLens;
+} Particle_Trails;
+
+typedef bool (*Particle_Sample_Func)(void *ctx, float x, float y, Vector2 *v);
+typedef bool (*Particle_Advect_Func)(void *ctx, float x, float y, Vector2 *v, Vector2 *move);
+
+typedef struct {
+    Particle_Sample_Func sample; // Needs to be safe to call from several threads at once
+    Particle_Advect_Func advect; // Replaces sample if set, also providing how far the particle moves. Otherwise particles move by half the field's value
+    void                *ctx;    // Passed to sample & advect
+    const Color *palette; // PALETTE_LEN colors, indexed by the squared magnitude of half the field's value
+    i32         width;
+    i32         height;
+    u32         seed;   // Seed for stochastically rounding quantized positions, which should change every step
+    Particle_Trails *trails; // If set, every particle pushes its position into its trail, whose trails->len lines are recorded after the count lines of the particles
+    atomic_uint culled; // Amount of particles that left the screen in the step
+    atomic_uint failed; // Amount of particles for which the field couldn't be sampled in the step
+} Particles_Step;
+
+// Coarse grid counting the particles per cell, used to spawn new particles where they are needed most
+typedef struct {
+    i32  width;      // Width of the screen area in pixels
+    i32  height;     // Height of the screen area in pixels
+    i32  cols;
+    i32  rows;
+    u32 *counts;       // Particles per cell at the start of the frame, updated as particles are spawned
+    u32 *threadCounts; // Private counts of each thread while binning
+    u32  threads;
+    u32 *spawnCells;   // Cells with less than target particles, ordered by their count at the start of the frame
+    u32 *offsets;      // Scratch space for sorting spawnCells, kept across frames
+    u32  offsetsCap;
+    u32  spawnLen;
+    u32  spawnCursor;
+    u32  level;      // All cells in spawnCells have at least this many particles
+    u32  target;     // Amount of particles per cell, if they were spread evenly
+    u32  limit;      // Amount of particles per cell, above which particles are retired
+    u32 *retireChances; // Chance per cell, that a particle in it is retired, scaled to UINT32_MAX
+    u32 *respawns;      // Particles collected for respawning, OCCUPANCY_BLOCK slots per block, flagged with OCCUPANCY_RESPAWN_*
+    u32 *respawnLens;   // Amount of particles collected per block
+    u32  respawnsCap;
+} Particle_Occupancy;
+
+void particlesInit(Particles *ps, u32 cap);
+void particlesSetQuantized(Particles *ps, bool quantized);
+Vector2 particleGetPos(const Particles *ps, u32 idx);
+void particleSetPos(Particles *ps, u32 idx, float x, float y);
+void particlesStep(Particles *ps, u32 count, Particles_Step *step, Line_Batch *out);
+void particlesSort(Particles *ps, u32 count, i32 width, i32 height, Particle_Sort *sort);
+void particlesFree(Particles *ps);
+void particleSortFree(Particle_Sort *sort);
+void lineBatchReserve(Line_Batch *batch, u32 cap);
+void lineBatchDraw(const Line_Batch *batch);
+void lineBatchFree(Line_Batch *batch);
+void lineRendererInit(Line_Renderer *renderer, u32 cap);
+void lineRendererDraw(Line_Renderer *renderer, const Line_Batch *batch);
+void lineRendererFree(Line_Renderer *renderer);
+
+void occupancyBegin(Particle_Occupancy *occ, const Particles *ps, u32 count, i32 width, i32 height);
+void occupancyCollect(Particle_Occupancy *occ, const Particles *ps, u32 count, u32 maxRetire, u32 seed);
+Vector2 occupancySpawnPos(Particle_Occupancy *occ, u32 *rng);
+void occupancyFree(Particle_Occupancy *occ);
+
+void trailsInit(Particle_Trails *trails, u32 particles, u32 len);
+void trailsSetLen(Particle_Trails *trails, u32 len);
+void trailsReset(Particle_Trails *trails, u32 idx);
+void trailsPush(Particle_Trails *trails, u32 idx, float x, float y);
+void trailsAdvance(Particle_Trails *trails);
+void trailsPermute(Particle_Trails *trails, const u32 *order, u32 count);
+void trailsFree(Particle_Trails *trails);
+
+#endif // _PARTICLES_H_
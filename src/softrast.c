@@ -0,0 +1,282 @@
+#include "softrast.h"
+#include "jobs.h"
+#include <math.h>
+
+void softrastInit(Soft_Raster *raster, i32 width, i32 height)
+{
+    *raster = (Soft_Raster){0};
+    raster->width     = width;
+    raster->height    = height;
+    raster->scale     = 1.0f;
+    raster->pixels    = malloc(width*height*sizeof(Color));
+    raster->cols      = (width  + SOFTRAST_TILE - 1)/SOFTRAST_TILE;
+    raster->rows      = (height + SOFTRAST_TILE - 1)/SOFTRAST_TILE;
+    raster->binStarts = malloc((raster->cols*raster->rows + 1)*sizeof(u32));
+    softrastClear(raster, BLACK);
+}
+
+typedef struct {
+    Soft_Raster *raster;
+    Color        color;
+    u32          retain; // 16.16 fixed point
+} Soft_Raster_Fill_Job;
+
+static void clearRows(void *arg, u32 from, u32 to, u32 thread)
+{
+    (void)thread;
+    Soft_Raster_Fill_Job *job = arg;
+    Color *pixels = &job->raster->pixels[from*job->raster->width];
+    for (u32 i = 0; i < (to - from)*job->raster->width; i++) pixels[i] = job->color;
+}
+
+void softrastClear(Soft_Raster *raster, Color color)
+{
+    Soft_Raster_Fill_Job job = { .raster = raster, .color = color };
+    jobsParallelFor(clearRows, &job, raster->height, 16);
+}
+
+static u8 blendChannel(u8 src, u8 dst, u32 alpha)
+{
+    return (src*alpha + dst*(255 - alpha) + 127)/255;
+}
+
+static void decayRows(void *arg, u32 from, u32 to, u32 thread)
+{
+    (void)thread;
+    Soft_Raster_Fill_Job *job = arg;
+    u32 retain = job->retain;
+    // @Note: Alpha is kept at 255, so that exported frames stay opaque
+    u8 *bytes = (u8 *)&job->raster->pixels[from*job->raster->width];
+    u32 n     = (to - from)*job->raster->width*4;
+    for (u32 i = 0; i < n; i += 4) {
+        bytes[i + 0] = (bytes[i + 0]*retain) >> 16;
+        bytes[i + 1] = (bytes[i + 1]*retain) >> 16;
+        bytes[i + 2] = (bytes[i + 2]*retain) >> 16;
+        bytes[i + 3] = 255;
+    }
+}
+
+// Multiplies all colors of the framebuffer by retain in a single pass, which fades out the lines of previous frames
+// @Note: Colors are rounded down, so that faded pixels reach black instead of getting stuck at a dim color
+void softrastDecay(Soft_Raster *raster, float retain)
+{
+    Soft_Raster_Fill_Job job = { .raster = raster, .retain = (u32)(AIL_CLAMP(retain, 0.0f, 1.0f)*65536.0f) };
+    jobsParallelFor(decayRows, &job, raster->height, 16);
+}
+
+typedef struct {
+    Soft_Raster      *raster;
+    const Line_Batch *batch;
+} Soft_Raster_Lines_Job;
+
+// Range of tiles covered by the line, including one pixel around it for anti-aliasing
+// Returns false if the line is invisible or completely off-screen
+static bool getLineTiles(const Soft_Raster *raster, const Line_Batch *batch, u32 idx, i32 *tx0, i32 *ty0, i32 *tx1, i32 *ty1)
+{
+    if (!batch->colors[idx].a) return false;
+    Vector2 a = { raster->scale*batch->points[2*idx].x,     raster->scale*batch->points[2*idx].y };
+    Vector2 b = { raster->scale*batch->points[2*idx + 1].x, raster->scale*batch->points[2*idx + 1].y };
+    float minX = AIL_MIN(a.x, b.x) - 1;
+    float minY = AIL_MIN(a.y, b.y) - 1;
+    float maxX = AIL_MAX(a.x, b.x) + 1;
+    float maxY = AIL_MAX(a.y, b.y) + 1;
+    if (maxX < 0 || maxY < 0 || minX >= raster->width || minY >= raster->height) return false;
+    *tx0 = (i32)AIL_MAX(minX, 0)/SOFTRAST_TILE;
+    *ty0 = (i32)AIL_MAX(minY, 0)/SOFTRAST_TILE;
+    *tx1 = (i32)AIL_MIN(maxX, raster->width  - 1)/SOFTRAST_TILE;
+    *ty1 = (i32)AIL_MIN(maxY, raster->height - 1)/SOFTRAST_TILE;
+    return true;
+}
+
+// Items are blocks of lines, so that every histogram covers the same lines, no matter which thread processes them
+static void countBins(void *arg, u32 from, u32 to, u32 thread)
+{
+    (void)thread;
+    Soft_Raster_Lines_Job *job    = arg;
+    Soft_Raster           *raster = job->raster;
+    u32 tiles = raster->cols*raster->rows;
+    for (u32 b = from; b < to; b++) {
+        u32 *counts = &raster->blockCounts[b*tiles];
+        memset(counts, 0, tiles*sizeof(u32));
+        u32 end = AIL_MIN((b + 1)*SOFTRAST_BIN_BLOCK, job->batch->len);
+        for (u32 i = b*SOFTRAST_BIN_BLOCK; i < end; i++) {
+            i32 tx0, ty0, tx1, ty1;
+            if (!getLineTiles(raster, job->batch, i, &tx0, &ty0, &tx1, &ty1)) continue;
+            for (i32 ty = ty0; ty <= ty1; ty++) {
+                for (i32 tx = tx0; tx <= tx1; tx++) counts[ty*raster->cols + tx]++;
+            }
+        }
+    }
+}
+
+static void fillBins(void *arg, u32 from, u32 to, u32 thread)
+{
+    (void)thread;
+    Soft_Raster_Lines_Job *job    = arg;
+    Soft_Raster           *raster = job->raster;
+    u32 tiles = raster->cols*raster->rows;
+    for (u32 b = from; b < to; b++) {
+        u32 *offsets = &raster->blockCounts[b*tiles];
+        u32  end     = AIL_MIN((b + 1)*SOFTRAST_BIN_BLOCK, job->batch->len);
+        for (u32 i = b*SOFTRAST_BIN_BLOCK; i < end; i++) {
+            i32 tx0, ty0, tx1, ty1;
+            if (!getLineTiles(raster, job->batch, i, &tx0, &ty0, &tx1, &ty1)) continue;
+            for (i32 ty = ty0; ty <= ty1; ty++) {
+                for (i32 tx = tx0; tx <= tx1; tx++) raster->binned[offsets[ty*raster->cols + tx]++] = i;
+            }
+        }
+    }
+}
+
+typedef struct {
+    Color *pixels;
+    i32    width;
+    i32    minX; // Bounds of the tile being drawn
+    i32    minY;
+    i32    maxX;
+    i32    maxY;
+} Soft_Raster_Tile;
+
+static void plot(const Soft_Raster_Tile *tile, i32 x, i32 y, Color c, float coverage)
+{
+    if (x < tile->minX || y < tile->minY || x >= tile->maxX || y >= tile->maxY) return;
+    Color *p = &tile->pixels[y*tile->width + x];
+    u32    a = (u32)(c.a*coverage + 0.5f);
+    *p = (Color){ blendChannel(c.r, p->r, a), blendChannel(c.g, p->g, a), blendChannel(c.b, p->b, a), 255 };
+}
+
+// Xiaolin Wu's anti-aliased line, restricted to the tile
+// @Note: Endpoints are rounded to whole pixels along the major axis instead of being weighted by their fractional coverage
+static void drawWuLine(const Soft_Raster_Tile *tile, Vector2 a, Vector2 b, Color c)
+{
+    // Pixel centers are at half coordinates
+    float x0 = a.x - 0.5f, y0 = a.y - 0.5f;
+    float x1 = b.x - 0.5f, y1 = b.y - 0.5f;
+    bool steep = fabsf(y1 - y0) > fabsf(x1 - x0);
+    if (steep) {
+        AIL_SWAP_PORTABLE(float, x0, y0);
+        AIL_SWAP_PORTABLE(float, x1, y1);
+    }
+    if (x0 > x1) {
+        AIL_SWAP_PORTABLE(float, x0, x1);
+        AIL_SWAP_PORTABLE(float, y0, y1);
+    }
+    float gradient = x1 > x0 ? (y1 - y0)/(x1 - x0) : 0.0f;
+    // Skip the parts of the line outside of the tile
+    i32   first    = steep ? tile->minY : tile->minX;
+    i32   last     = steep ? tile->maxY : tile->maxX;
+    i32   start    = (i32)roundf(AIL_MAX(x0, first));
+    i32   end      = (i32)roundf(AIL_MIN(x1, last - 1));
+    for (i32 x = start; x <= end; x++) {
+        float y  = y0 + gradient*(x - x0);
+        i32   yi = (i32)floorf(y);
+        float f  = y - yi;
+        if (steep) {
+            plot(tile, yi,     x, c, 1 - f);
+            plot(tile, yi + 1, x, c, f);
+        } else {
+            plot(tile, x, yi,     c, 1 - f);
+            plot(tile, x, yi + 1, c, f);
+        }
+    }
+}
+
+static void drawTiles(void *arg, u32 from, u32 to, u32 thread)
+{
+    (void)thread;
+    Soft_Raster_Lines_Job *job    = arg;
+    Soft_Raster           *raster = job->raster;
+    for (u32 t = from; t < to; t++) {
+        Soft_Raster_Tile tile = {
+            .pixels = raster->pixels,
+            .width  = raster->width,
+            .minX   = t % raster->cols*SOFTRAST_TILE,
+            .minY   = t / raster->cols*SOFTRAST_TILE,
+        };
+        tile.maxX = AIL_MIN(tile.minX + SOFTRAST_TILE, raster->width);
+        tile.maxY = AIL_MIN(tile.minY + SOFTRAST_TILE, raster->height);
+        for (u32 k = raster->binStarts[t]; k < raster->binStarts[t + 1]; k++) {
+            u32     i = raster->binned[k];
+            Vector2 a = { raster->scale*job->batch->points[2*i].x,     raster->scale*job->batch->points[2*i].y };
+            Vector2 b = { raster->scale*job->batch->points[2*i + 1].x, raster->scale*job->batch->points[2*i + 1].y };
+            drawWuLine(&tile, a, b, job->batch->colors[i]);
+        }
+    }
+}
+
+// Blends all visible lines of the batch onto the framebuffer in order, like lineBatchDraw does on the GPU
+void softrastDrawLines(Soft_Raster *raster, const Line_Batch *batch)
+{
+    if (!batch->len) return;
+    u32 tiles  = raster->cols*raster->rows;
+    u32 blocks = (batch->len + SOFTRAST_BIN_BLOCK - 1)/SOFTRAST_BIN_BLOCK;
+    if (blocks*tiles > raster->blockCountsCap) {
+        raster->blockCountsCap = blocks*tiles;
+        raster->blockCounts    = realloc(raster->blockCounts, raster->blockCountsCap*sizeof(u32));
+    }
+    Soft_Raster_Lines_Job job = { .raster = raster, .batch = batch };
+    jobsParallelFor(countBins, &job, blocks, 1);
+
+    // Offsets are ordered by tile first and block second, so every tile's lines keep the order of the batch
+    u32 offset = 0;
+    for (u32 t = 0; t < tiles; t++) {
+        raster->binStarts[t] = offset;
+        for (u32 b = 0; b < blocks; b++) {
+            u32 n = raster->blockCounts[b*tiles + t];
+            raster->blockCounts[b*tiles + t] = offset;
+            offset += n;
+        }
+    }
+    raster->binStarts[tiles] = offset;
+    if (offset > raster->binnedCap) {
+        raster->binnedCap = AIL_MAX(offset, 2*raster->binnedCap);
+        raster->binned    = realloc(raster->binned, raster->binnedCap*sizeof(u32));
+    }
+    jobsParallelFor(fillBins, &job, blocks, 1);
+    jobsParallelFor(drawTiles, &job, tiles, 1);
+}
+
+typedef struct {
+    const Soft_Raster *raster;
+    u32                factor;
+    Color             *out;
+} Soft_Raster_Downsample_Job;
+
+static void downsampleRows(void *arg, u32 from, u32 to, u32 thread)
+{
+    (void)thread;
+    Soft_Raster_Downsample_Job *job = arg;
+    u32 f     = job->factor;
+    u32 width = job->raster->width/f;
+    u32 n     = f*f;
+    for (u32 y = from; y < to; y++) {
+        for (u32 x = 0; x < width; x++) {
+            u32 r = 0, g = 0, b = 0;
+            for (u32 dy = 0; dy < f; dy++) {
+                const Color *row = &job->raster->pixels[(y*f + dy)*job->raster->width + x*f];
+                for (u32 dx = 0; dx < f; dx++) {
+                    r += row[dx].r;
+                    g += row[dx].g;
+                    b += row[dx].b;
+                }
+            }
+            job->out[y*width + x] = (Color){ (r + n/2)/n, (g + n/2)/n, (b + n/2)/n, 255 };
+        }
+    }
+}
+
+// Averages blocks of factor*factor pixels (a box filter) into out, which needs to hold (width/factor)*(height/factor) pixels
+void softrastDownsample(const Soft_Raster *raster, u32 factor, Color *out)
+{
+    Soft_Raster_Downsample_Job job = { .raster = raster, .factor = factor, .out = out };
+    jobsParallelFor(downsampleRows, &job, raster->height/factor, 4);
+}
+
+void softrastFree(Soft_Raster *raster)
+{
+    free(raster->pixels);
+    free(raster->binStarts);
+    free(raster->binned);
+    free(raster->blockCounts);
+    *raster = (Soft_Raster){0};
+}
@@ -0,0 +1,37 @@
+#ifndef _SOFTRAST_H_
+#define _SOFTRAST_H_
+
+#define  AIL_ALL_IMPL
+#include "ail.h"
+#include "raylib.h"
+#include "particles.h"
+
+#define SOFTRAST_TILE      64    // Size in pixels of the tiles, that are rasterized in parallel
+#define SOFTRAST_BIN_BLOCK 16384 // Amount of lines per histogram while binning lines into tiles
+
+// Framebuffer in memory, that line batches are rasterized into on the CPU, so that frames can be rendered without a window or GPU
+// Lines are binned into tiles first, then every tile draws its lines independently of the others
+// It also serves as the accumulation buffer of the trails, when rendering without a window
+// @Note: Pixels stay opaque, since lines are blended onto the framebuffer like raylib blends them onto the screen
+typedef struct {
+    i32    width;
+    i32    height;
+    Color *pixels;      // width*height pixels, row by row
+    float  scale;       // Factor the coordinates of lines are multiplied with, so lines simulated on a smaller screen can be drawn at a higher resolution. 1 by default
+    i32    cols;        // Amount of tiles per row
+    i32    rows;        // Amount of tiles per column
+    u32   *binStarts;   // Index of the first line of every tile in binned, plus the end of the last tile's lines
+    u32   *binned;      // Indices of the lines overlapping every tile, ordered by tile and then by line, so drawing is deterministic
+    u32    binnedCap;
+    u32   *blockCounts; // Lines per block of lines and tile, turned into the offsets of every block in binned
+    u32    blockCountsCap;
+} Soft_Raster;
+
+void softrastInit(Soft_Raster *raster, i32 width, i32 height);
+void softrastClear(Soft_Raster *raster, Color color);
+void softrastDecay(Soft_Raster *raster, float retain);
+void softrastDrawLines(Soft_Raster *raster, const Line_Batch *batch);
+void softrastDownsample(const Soft_Raster *raster, u32 factor, Color *out);
+void softrastFree(Soft_Raster *raster);
+
+#endif // _SOFTRAST_H_